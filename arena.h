@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2015-2016 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _SHERLOCK_ARENA_H
+#define _SHERLOCK_ARENA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+/*****************************************************************************
+ * API START
+ *****************************************************************************/
+
+/*
+ * byte-budgeted ring of variable-sized records in one contiguous region,
+ * records are never split at the wrap around, but start over at the beginning
+ * of the region. Records can be marked as first of a group, whole groups are
+ * evicted from the oldest end. Group heads carry a hidden record count, the
+ * index only holds 32 bit offsets, so regions are limited to 2 GiB. The index
+ * is sized for records of the expected average size, allocation fails when
+ * either the region or the index is used up.
+ */
+typedef struct _arena_t arena_t;
+
+struct _arena_t {
+	uint8_t *buf;
+	size_t size; // power of two
+	size_t head; // monotonic byte position of next record
+	size_t tail; // monotonic byte position of oldest record
+	uint32_t *index; // offsets of records
+	size_t mask; // of index
+	size_t first; // record number of oldest record
+	size_t last; // record number of next record
+	size_t headless; // oldest records without a group
+	size_t group; // record number of newest group head
+	bool open; // whether newest group is still alive
+};
+
+#define ARENA_MAX_SIZE 0x80000000
+
+// non-rt, size is rounded up to a power of two
+static inline bool
+arena_init(arena_t *arena, size_t size, size_t avg_record);
+
+// non-rt
+static inline void
+arena_deinit(arena_t *arena);
+
+// O(1), returns NULL when out of space, evict and retry
+static inline void *
+arena_alloc(arena_t *arena, size_t size, bool mark);
+
+// O(1), drops oldest group, returns false when empty or oldest group is kept
+static inline bool
+arena_evict(arena_t *arena, bool keep);
+
+// O(1)
+static inline void
+arena_clear(arena_t *arena);
+
+// O(1), number of live records
+static inline size_t
+arena_count(const arena_t *arena);
+
+// O(1), i-th live record, counted from the oldest
+static inline void *
+arena_get(const arena_t *arena, size_t i);
+
+// O(1), record number of i-th live record
+static inline size_t
+arena_id(const arena_t *arena, size_t i);
+
+/*****************************************************************************
+ * API END
+ *****************************************************************************/
+
+#define ARENA_ALIGN 8
+#define ARENA_HEAD sizeof(size_t)
+
+static inline size_t
+_arena_pow2(size_t size)
+{
+	size_t pow2 = 1;
+
+	while(pow2 < size)
+		pow2 <<= 1;
+
+	return pow2;
+}
+
+static inline bool
+arena_init(arena_t *arena, size_t size, size_t avg_record)
+{
+	if(size > ARENA_MAX_SIZE)
+		size = ARENA_MAX_SIZE;
+
+	arena->size = _arena_pow2(size);
+
+	// smaller records on average run out of index before region
+	const size_t records = _arena_pow2(arena->size / avg_record);
+
+	arena->mask = records - 1;
+	arena->buf = malloc(arena->size);
+	arena->index = malloc(records * sizeof(uint32_t));
+
+	if(!arena->buf || !arena->index)
+	{
+		arena_deinit(arena);
+		return false;
+	}
+
+	arena_clear(arena);
+
+	return true;
+}
+
+static inline void
+arena_deinit(arena_t *arena)
+{
+	free(arena->buf);
+	free(arena->index);
+
+	arena->buf = NULL;
+	arena->index = NULL;
+}
+
+static inline size_t *
+_arena_head(const arena_t *arena, size_t id)
+{
+	const uint32_t offset = arena->index[id & arena->mask];
+
+	return (size_t *)&arena->buf[offset - ARENA_HEAD];
+}
+
+static inline void *
+arena_alloc(arena_t *arena, size_t size, bool mark)
+{
+	const size_t head = mark ? ARENA_HEAD : 0;
+	size = (head + size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	if( (size > arena->size) || (arena->last - arena->first > arena->mask) )
+		return NULL;
+
+	// records do not wrap around, skip to start of region instead
+	const size_t offset = arena->head & (arena->size - 1);
+	const size_t skip = offset + size > arena->size
+		? arena->size - offset
+		: 0;
+
+	if(arena->size - (arena->head - arena->tail) < skip + size)
+		return NULL;
+
+	const size_t pos = arena->head + skip;
+	arena->head = pos + size;
+
+	if(arena->first == arena->last)
+		arena->tail = pos;
+
+	const size_t id = arena->last++;
+	arena->index[id & arena->mask] = (pos & (arena->size - 1)) + head;
+
+	if(mark)
+	{
+		arena->group = id;
+		arena->open = true;
+		*_arena_head(arena, id) = 1;
+	}
+	else if(arena->open)
+	{
+		*_arena_head(arena, arena->group) += 1;
+	}
+	else
+	{
+		arena->headless += 1;
+	}
+
+	return arena_get(arena, id - arena->first);
+}
+
+static inline bool
+arena_evict(arena_t *arena, bool keep)
+{
+	if(arena->first == arena->last)
+		return false;
+
+	// newest group may still be appended to
+	if(keep && !arena->headless && arena->open && (arena->first == arena->group) )
+		return false;
+
+	if(arena->headless)
+	{
+		arena->first += arena->headless;
+		arena->headless = 0;
+	}
+	else
+	{
+		if(arena->first == arena->group) // newest group is gone, too
+			arena->open = false;
+
+		arena->first += *_arena_head(arena, arena->first);
+	}
+
+	if(arena->first == arena->last)
+	{
+		arena->tail = arena->head;
+	}
+	else // monotonic position of the group head, which lies behind head
+	{
+		const size_t offset = arena->index[arena->first & arena->mask] - ARENA_HEAD;
+		size_t used = (arena->head - offset) & (arena->size - 1);
+
+		if(used == 0) // exactly full
+			used = arena->size;
+
+		arena->tail = arena->head - used;
+	}
+
+	return true;
+}
+
+static inline void
+arena_clear(arena_t *arena)
+{
+	arena->head = 0;
+	arena->tail = 0;
+	arena->first = 0;
+	arena->last = 0;
+	arena->headless = 0;
+	arena->group = 0;
+	arena->open = false;
+}
+
+static inline size_t
+arena_count(const arena_t *arena)
+{
+	return arena->last - arena->first;
+}
+
+static inline void *
+arena_get(const arena_t *arena, size_t i)
+{
+	return &arena->buf[arena->index[(arena->first + i) & arena->mask]];
+}
+
+static inline size_t
+arena_id(const arena_t *arena, size_t i)
+{
+	return arena->first + i;
+}
+
+#endif // _SHERLOCK_ARENA_H
@@ -15,6 +15,7 @@
  * http://www.perlfoundation.org/artistic_license_2_0.
  */
 
+#include <stdio.h>
 #include <ctype.h>
 #include <inttypes.h>
 
@@ -130,6 +131,112 @@ _shadow(struct nk_context *ctx, bool *shadow)
 	*shadow = !*shadow;
 }
 
+void
+_atom_inspector_decode(plughandle_t *handle, item_t *itm)
+{
+	const LV2_Atom *body = &itm->event.ev.body;
+	row_t *row = _item_row(itm);
+	const char *uri = NULL;
+
+	if(lv2_atom_forge_is_object_type(&handle->forge, body->type))
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)body;
+
+		if(obj->body.otype)
+			uri = handle->unmap->unmap(handle->unmap->handle, obj->body.otype);
+		else if(obj->body.id)
+			uri = handle->unmap->unmap(handle->unmap->handle, obj->body.id);
+	}
+	else // not an object
+	{
+		uri = handle->unmap->unmap(handle->unmap->handle, body->type);
+	}
+
+	row->atom.uri = uri ? uri : "Unknown";
+
+	snprintf(row->frames, sizeof(row->frames), "+%04"PRIi64, itm->event.ev.time.frames);
+	snprintf(row->size, sizeof(row->size), "%"PRIu32, body->size);
+
+	row->atom.value[0] = '\0';
+	row->atom.color = green;
+
+	if(body->type == handle->forge.Bool)
+	{
+		const LV2_Atom_Bool *ref = (const LV2_Atom_Bool *)body;
+		snprintf(row->atom.value, sizeof(row->atom.value), "%s", ref->body ? "true" : "false");
+		row->atom.color = violet;
+	}
+	else if(body->type == handle->forge.Int)
+	{
+		const LV2_Atom_Int *ref = (const LV2_Atom_Int *)body;
+		snprintf(row->atom.value, sizeof(row->atom.value), "%"PRIi32, ref->body);
+	}
+	else if(body->type == handle->forge.Long)
+	{
+		const LV2_Atom_Long *ref = (const LV2_Atom_Long *)body;
+		snprintf(row->atom.value, sizeof(row->atom.value), "%"PRIi64, ref->body);
+	}
+	else if(body->type == handle->forge.Float)
+	{
+		const LV2_Atom_Float *ref = (const LV2_Atom_Float *)body;
+		snprintf(row->atom.value, sizeof(row->atom.value), "%f", ref->body);
+	}
+	else if(body->type == handle->forge.Double)
+	{
+		const LV2_Atom_Double *ref = (const LV2_Atom_Double *)body;
+		snprintf(row->atom.value, sizeof(row->atom.value), "%lf", ref->body);
+	}
+}
+
+// space or comma separated list of URIs, first one is the filter property
+static void
+_filter_to_string(plughandle_t *handle)
+{
+	char *ptr = handle->filter_uri;
+	const char *end = ptr + sizeof(handle->filter_uri) - 1;
+
+	*ptr = '\0';
+	for(int i = -1; i < (int)handle->nfilters; i++)
+	{
+		const LV2_URID urid = (i == -1)
+			? handle->state.filter
+			: handle->state.filters.urids[i];
+		const char *uri = handle->unmap->unmap(handle->unmap->handle, urid);
+
+		if(uri)
+			ptr += snprintf(ptr, end - ptr, "%s%s", ptr == handle->filter_uri ? "" : " ", uri);
+
+		if(ptr >= end)
+			break;
+	}
+}
+
+static void
+_filter_from_string(plughandle_t *handle)
+{
+	char *saveptr = NULL;
+	uint32_t n = 0;
+
+	handle->state.filter = 0;
+	for(char *uri = strtok_r(handle->filter_uri, " ,", &saveptr);
+		uri;
+		uri = strtok_r(NULL, " ,", &saveptr))
+	{
+		const LV2_URID urid = handle->map->map(handle->map->handle, uri);
+
+		if(!handle->state.filter)
+			handle->state.filter = urid;
+		else if(n < MAX_FILTERS)
+			handle->state.filters.urids[n++] = urid;
+	}
+	handle->nfilters = n;
+
+	_set_urid(handle, handle->urid.filter, handle->state.filter);
+	_set_urids(handle, handle->urid.filters, n, handle->state.filters.urids);
+
+	handle->filter_dirty = true; // normalize editor text
+}
+
 void
 _atom_inspector_expose(struct nk_context *ctx, struct nk_rect wbounds, void *data)
 {
@@ -155,21 +262,11 @@ _atom_inspector_expose(struct nk_context *ctx, struct nk_rect wbounds, void *dat
 		if(nk_group_begin(ctx, "Left", NK_WINDOW_NO_SCROLLBAR))
 		{
 			{
-				// has filter URID been updated meanwhile ?
-				if(handle->filter != handle->state.filter)
+				// has filter set been updated meanwhile ?
+				if(handle->filter_dirty)
 				{
-					const char *uri = handle->unmap->unmap(handle->unmap->handle, handle->state.filter);
-
-					if(uri)
-					{
-						strncpy(handle->filter_uri, uri, sizeof(handle->filter_uri) - 1);
-					}
-					else
-					{
-						handle->filter_uri[0] = '\0';
-					}
-
-					handle->filter = handle->state.filter;
+					_filter_to_string(handle);
+					handle->filter_dirty = false;
 				}
 
 				nk_layout_row_dynamic(ctx, widget_h, 1);
@@ -185,13 +282,43 @@ _atom_inspector_expose(struct nk_context *ctx, struct nk_rect wbounds, void *dat
 						strncpy(handle->filter_uri, LV2_TIME__Position, sizeof(handle->filter_uri) - 1);
 					}
 
-					handle->state.filter = handle->map->map(handle->map->handle, handle->filter_uri);
+					_filter_from_string(handle);
+				}
 
-					_set_urid(handle, handle->urid.filter, handle->state.filter);
+				// has predicate been updated meanwhile ?
+				if(handle->predicate_dirty)
+				{
+					char *expr = predicate_decompile(&handle->state.predicate, handle->npredicate, handle->unmap);
+
+					if(expr)
+					{
+						strncpy(handle->predicate_expr, expr, sizeof(handle->predicate_expr) - 1);
+						free(expr);
+					}
+
+					handle->predicate_error = false;
+					handle->predicate_dirty = false;
 				}
+
+				const float ratio [2] = {0.85f, 0.15f};
+				nk_layout_row(ctx, NK_DYNAMIC, widget_h, 2, ratio);
+				mode = nk_edit_string_zero_terminated(ctx, flags, handle->predicate_expr, sizeof(handle->predicate_expr) - 1, nk_filter_ascii);
+				if(mode & NK_EDIT_COMMITED)
+				{
+					predicate_t pred;
+					const int size = predicate_compile(&pred, handle->predicate_expr, handle->map);
+
+					handle->predicate_error = size < 0;
+					if(!handle->predicate_error)
+						_set_chunk(handle, handle->urid.predicate, size, &pred);
+				}
+				if(handle->predicate_error)
+					nk_label_colored(ctx, "syntax error", NK_TEXT_RIGHT, nk_rgb(0xff, 0x00, 0x00));
+				else
+					nk_label(ctx, "predicate", NK_TEXT_RIGHT);
 			}
 
-			const float content_h = nk_window_get_height(ctx) - 2*window_padding.y - 5*group_padding.y - 3*widget_h;
+			const float content_h = nk_window_get_height(ctx) - 2*window_padding.y - 6*group_padding.y - 4*widget_h;
 			nk_layout_row_dynamic(ctx, content_h, 1);
 			nk_flags flags = NK_WINDOW_BORDER;
 			if(handle->state.follow)
@@ -203,7 +330,9 @@ _atom_inspector_expose(struct nk_context *ctx, struct nk_rect wbounds, void *dat
 				handle->shadow = false;
 			}
 			struct nk_list_view lview;
-			if(nk_list_view_begin(ctx, &lview, "Events", flags, widget_h, NK_MIN(handle->n_item, MAX_LINES)))
+			if(handle->state.stats)
+				_stats_view(handle, ctx);
+			else if(nk_list_view_begin(ctx, &lview, "Events", flags, widget_h, handle->n_item))
 			{
 				if(handle->state.follow)
 				{
@@ -212,7 +341,7 @@ _atom_inspector_expose(struct nk_context *ctx, struct nk_rect wbounds, void *dat
 				}
 				for(int l = lview.begin; (l < lview.end) && (l < handle->n_item); l++)
 				{
-					item_t *itm = handle->items[l];
+					item_t *itm = _item_get(handle, l);
 
 					switch(itm->type)
 					{
@@ -236,96 +365,36 @@ _atom_inspector_expose(struct nk_context *ctx, struct nk_rect wbounds, void *dat
 							nk_labelf_colored(ctx, NK_TEXT_RIGHT, violet, "%"PRIi32, itm->frame.nsamples);
 						} break;
 
-						case ITEM_TYPE_EVENT:
+						case ITEM_TYPE_MARKER:
 						{
-							LV2_Atom_Event *ev = &itm->event.ev;
-							const LV2_Atom *body = &ev->body;
-							const int64_t frames = ev->time.frames;
-							const char *uri = NULL;
-							if(lv2_atom_forge_is_object_type(&handle->forge, body->type))
-							{
-								const LV2_Atom_Object *obj = (const LV2_Atom_Object *)body;
+							_marker_view(handle, ctx, itm);
+						} break;
 
-								if(obj->body.otype)
-									uri = handle->unmap->unmap(handle->unmap->handle, obj->body.otype);
-								else if(obj->body.id)
-									uri = handle->unmap->unmap(handle->unmap->handle, obj->body.id);
-								else
-									uri = "Unknown";
-							}
-							else // not an object
-							{
-								uri = handle->unmap->unmap(handle->unmap->handle, body->type);
-							}
+						case ITEM_TYPE_EVENT:
+						{
+							const LV2_Atom *body = &itm->event.ev.body;
+							const row_t *row = _item_row(itm);
 
 							const float entry [4] = {0.1, 0.65, 0.15, 0.1};
 							nk_layout_row(ctx, NK_DYNAMIC, widget_h, 4, entry);
 							{
 								_shadow(ctx, &handle->shadow);
-								nk_labelf_colored(ctx, NK_TEXT_LEFT, yellow, "+%04"PRIi64, frames);
+								nk_label_colored(ctx, row->frames, NK_TEXT_LEFT, yellow);
 
-								if(nk_select_label(ctx, uri, NK_TEXT_LEFT, handle->selected == body))
+								if(nk_select_label(ctx, row->atom.uri, NK_TEXT_LEFT, handle->selected == body))
 								{
 									handle->ttl_dirty = handle->ttl_dirty
 										|| (handle->selected != body); // has selection actually changed?
 									handle->selected = body;
+									handle->selected_item = arena_id(&handle->arena, l);
 								}
 
-								if(body->type == handle->forge.Bool)
-								{
-									const LV2_Atom_Bool *ref = (const LV2_Atom_Bool *)body;
-									nk_labelf_colored(ctx, NK_TEXT_RIGHT, violet, "%s", ref->body ? "true" : "false");
-								}
-								else if(body->type == handle->forge.Int)
-								{
-									const LV2_Atom_Int *ref = (const LV2_Atom_Int *)body;
-									nk_labelf_colored(ctx, NK_TEXT_RIGHT, green, "%"PRIi32, ref->body);
-								}
-								else if(body->type == handle->forge.Long)
-								{
-									const LV2_Atom_Long *ref = (const LV2_Atom_Long *)body;
-									nk_labelf_colored(ctx, NK_TEXT_RIGHT, green, "%"PRIi64, ref->body);
-								}
-								else if(body->type == handle->forge.Float)
-								{
-									const LV2_Atom_Float *ref = (const LV2_Atom_Float *)body;
-									nk_labelf_colored(ctx, NK_TEXT_RIGHT, green, "%f", ref->body);
-								}
-								else if(body->type == handle->forge.Double)
-								{
-									const LV2_Atom_Double *ref = (const LV2_Atom_Double *)body;
-									nk_labelf_colored(ctx, NK_TEXT_RIGHT, green, "%lf", ref->body);
-								}
-								/*
-								else if(body->type == handle->forge.String)
-								{
-									nk_label_colored(ctx, LV2_ATOM_BODY_CONST(body), NK_TEXT_RIGHT, red);
-								}
-								else if(body->type == handle->forge.URI)
-								{
-									nk_label_colored(ctx, LV2_ATOM_BODY_CONST(body), NK_TEXT_RIGHT, yellow);
-								}
-								else if(body->type == handle->forge.URID)
-								{
-									const LV2_Atom_URID *urid = (const LV2_Atom_URID *)body;
-									const char *_uri = handle->unmap->unmap(handle->unmap->handle, urid->body);
-									nk_label_colored(ctx, _uri, NK_TEXT_RIGHT, yellow);
-								}
-								else if(body->type == handle->forge.Path)
-								{
-									nk_label_colored(ctx, LV2_ATOM_BODY_CONST(body), NK_TEXT_RIGHT, red);
-								}
-								else if(body->type == handle->forge.Literal)
-								{
-									nk_label_colored(ctx, LV2_ATOM_CONTENTS_CONST(LV2_Atom_Literal, body), NK_TEXT_RIGHT, red);
-								}
-								*/
+								if(row->atom.value[0])
+									nk_label_colored(ctx, row->atom.value, NK_TEXT_RIGHT, row->atom.color);
 								else
-								{
 									nk_spacing(ctx, 1);
-								}
 
-								nk_labelf_colored(ctx, NK_TEXT_RIGHT, blue, "%"PRIu32, body->size);
+								nk_label_colored(ctx, row->size, NK_TEXT_RIGHT, blue);
 							}
 						} break;
 					}
@@ -334,12 +403,12 @@ _atom_inspector_expose(struct nk_context *ctx, struct nk_rect wbounds, void *dat
 				nk_list_view_end(&lview);
 			}
 
-			const float n = 5;
+			const float n = 8;
 			const float r0 = 1.f / n;
 			const float r1 = 0.1f / 3;
 			const float r2 = r0 - r1;
-			const float footer [10] = {r1, r2, r1, r2, r1, r2, r1, r2, r1, r2};
-			nk_layout_row(ctx, NK_DYNAMIC, widget_h, 10, footer);
+			const float footer [16] = {r1, r2, r1, r2, r1, r2, r1, r2, r1, r2, r1, r2, r1, r2, r1, r2};
+			nk_layout_row(ctx, NK_DYNAMIC, widget_h, 16, footer);
 			{
 				const int32_t state_overwrite = _check(ctx, handle->state.overwrite);
 				if(state_overwrite != handle->state.overwrite)
@@ -382,16 +451,47 @@ _atom_inspector_expose(struct nk_context *ctx, struct nk_rect wbounds, void *dat
 					_set_bool(handle, handle->urid.negate, handle->state.negate);
 				}
 				nk_label(ctx, "negate", NK_TEXT_LEFT);
+
+				const int32_t state_lossless = _check(ctx, handle->state.lossless);
+				if(state_lossless != handle->state.lossless)
+				{
+					handle->state.lossless = state_lossless;
+					_set_bool(handle, handle->urid.lossless, handle->state.lossless);
+				}
+				nk_label(ctx, "lossless", NK_TEXT_LEFT);
+
+				const int32_t state_record = _check(ctx, handle->state.record);
+				if(state_record != handle->state.record)
+				{
+					handle->state.record = state_record;
+					_set_bool(handle, handle->urid.record, handle->state.record);
+				}
+				nk_label(ctx, "record", NK_TEXT_LEFT);
+
+				const int32_t state_stats = _check(ctx, handle->state.stats);
+				if(state_stats != handle->state.stats)
+				{
+					handle->state.stats = state_stats;
+					_set_bool(handle, handle->urid.stats, handle->state.stats);
+				}
+				nk_label(ctx, "stats", NK_TEXT_LEFT);
 			}
 
-			const bool max_reached = handle->n_item >= MAX_LINES;
-			nk_layout_row_dynamic(ctx, widget_h, 2);
+			const bool max_reached = handle->full;
+			nk_layout_row_dynamic(ctx, widget_h, 5);
 			if(nk_button_symbol_label(ctx,
 				max_reached ? NK_SYMBOL_TRIANGLE_RIGHT: NK_SYMBOL_NONE,
 				"clear", NK_TEXT_LEFT))
 			{
 				_clear(handle);
 			}
+			if(handle->dropped || handle->skipped)
+				nk_labelf(ctx, NK_TEXT_CENTERED, "dropped: %"PRIi64" skipped: %"PRIi64,
+					handle->dropped, handle->skipped);
+			else
+				_empty(ctx);
+			_probe_view(handle, ctx);
+			_record_edit(handle, ctx);
 			nk_label(ctx, "Sherlock.lv2: "SHERLOCK_VERSION, NK_TEXT_RIGHT);
 
 			nk_group_end(ctx);
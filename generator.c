@@ -0,0 +1,484 @@
+/*
+ * Copyright (c) 2015-2016 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sherlock.h>
+
+#include <osc.lv2/forge.h>
+
+#define GENERATOR_NPROPS 5
+#define GENERATOR_MAX_EVENTS 0x10000 // per cycle
+#define GENERATOR_MAX_SYSEX 0x10000 // bytes
+
+typedef enum _generator_kind_t generator_kind_t;
+typedef struct _generator_state_t generator_state_t;
+typedef struct _generator_t generator_t;
+
+enum _generator_kind_t {
+	GENERATOR_NOTE				= (1 << 0),
+	GENERATOR_CONTROLLER	= (1 << 1),
+	GENERATOR_SYSEX				= (1 << 2),
+	GENERATOR_MESSAGE			= (1 << 3),
+	GENERATOR_BUNDLE			= (1 << 4),
+	GENERATOR_OBJECT			= (1 << 5),
+
+	GENERATOR_ALL					= (1 << 6) - 1
+};
+
+struct _generator_state_t {
+	int32_t kinds;
+	int32_t events;
+	int32_t bytes;
+	int32_t sysex_size;
+	int32_t seed;
+};
+
+struct _generator_t {
+	struct {
+		LV2_URID midi_event;
+		LV2_URID storm;
+		LV2_URID counter;
+		LV2_URID value;
+	} urid;
+
+	LV2_URID_Map *map;
+	LV2_Log_Log *log;
+	LV2_Log_Logger logger;
+	LV2_OSC_URID osc_urid;
+
+	const LV2_Atom_Sequence *control;
+	craft_t event;
+	craft_t notify;
+
+	PROPS_T(props, GENERATOR_NPROPS);
+	generator_state_t state;
+	generator_state_t stash;
+
+	uint32_t kind; // next kind to emit
+	uint32_t counter;
+	uint32_t random;
+
+	uint8_t sysex [GENERATOR_MAX_SYSEX];
+};
+
+static void
+_seed_changed(void *data, int64_t frames, props_impl_t *impl);
+
+static const props_def_t generator_defs [GENERATOR_NPROPS] = {
+	{
+		.property = SHERLOCK_URI"#kinds",
+		.offset = offsetof(generator_state_t, kinds),
+		.type = LV2_ATOM__Int
+	},
+	{
+		.property = SHERLOCK_URI"#eventsPerCycle",
+		.offset = offsetof(generator_state_t, events),
+		.type = LV2_ATOM__Int
+	},
+	{
+		.property = SHERLOCK_URI"#bytesPerCycle",
+		.offset = offsetof(generator_state_t, bytes),
+		.type = LV2_ATOM__Int
+	},
+	{
+		.property = SHERLOCK_URI"#sysexSize",
+		.offset = offsetof(generator_state_t, sysex_size),
+		.type = LV2_ATOM__Int
+	},
+	{
+		.property = SHERLOCK_URI"#seed",
+		.offset = offsetof(generator_state_t, seed),
+		.type = LV2_ATOM__Int,
+		.event_cb = _seed_changed
+	}
+};
+
+// rt-safe, restarts the sequence so runs with equal settings are identical
+static void
+_seed_changed(void *data, int64_t frames, props_impl_t *impl)
+{
+	generator_t *handle = data;
+
+	handle->kind = 0;
+	handle->counter = 0;
+	handle->random = handle->state.seed;
+}
+
+// rt-safe, xorshift32
+static inline uint32_t
+_random(generator_t *handle)
+{
+	uint32_t x = handle->random ? handle->random : 0x9e3779b9;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+
+	return (handle->random = x);
+}
+
+static LV2_Handle
+instantiate(const LV2_Descriptor* descriptor, double rate,
+	const char *bundle_path, const LV2_Feature *const *features)
+{
+	generator_t *handle = calloc(1, sizeof(generator_t));
+	if(!handle)
+		return NULL;
+
+	for(int i=0; features[i]; i++)
+	{
+		if(!strcmp(features[i]->URI, LV2_URID__map))
+			handle->map = features[i]->data;
+		else if(!strcmp(features[i]->URI, LV2_LOG__log))
+			handle->log = features[i]->data;
+	}
+
+	if(!handle->map)
+	{
+		fprintf(stderr, "%s: Host does not support urid:map\n", descriptor->URI);
+		free(handle);
+		return NULL;
+	}
+
+	if(handle->log)
+		lv2_log_logger_init(&handle->logger, handle->map, handle->log);
+
+	lv2_atom_forge_init(&handle->event.forge, handle->map);
+	lv2_atom_forge_init(&handle->notify.forge, handle->map);
+	lv2_osc_urid_init(&handle->osc_urid, handle->map);
+
+	handle->urid.midi_event = handle->map->map(handle->map->handle, LV2_MIDI__MidiEvent);
+	handle->urid.storm = handle->map->map(handle->map->handle, SHERLOCK_URI"#Storm");
+	handle->urid.counter = handle->map->map(handle->map->handle, SHERLOCK_URI"#counter");
+	handle->urid.value = handle->map->map(handle->map->handle, SHERLOCK_URI"#value");
+
+	// sysex payload is constant, only its length varies
+	handle->sysex[0] = LV2_MIDI_MSG_SYSTEM_EXCLUSIVE;
+	for(unsigned i = 1; i < GENERATOR_MAX_SYSEX; i++)
+		handle->sysex[i] = i & 0x7f;
+
+	handle->state.kinds = handle->stash.kinds = GENERATOR_ALL;
+	handle->state.events = handle->stash.events = 64;
+	handle->state.sysex_size = handle->stash.sysex_size = 256;
+
+	if(!props_init(&handle->props, descriptor->URI,
+		generator_defs, GENERATOR_NPROPS, &handle->state, &handle->stash,
+		handle->map, handle))
+	{
+		fprintf(stderr, "failed to allocate property structure\n");
+		free(handle);
+		return NULL;
+	}
+
+	return handle;
+}
+
+static void
+connect_port(LV2_Handle instance, uint32_t port, void *data)
+{
+	generator_t *handle = (generator_t *)instance;
+
+	switch(port)
+	{
+		case 0:
+			handle->control = (const LV2_Atom_Sequence *)data;
+			break;
+		case 1:
+			handle->event.seq = (LV2_Atom_Sequence *)data;
+			break;
+		case 2:
+			handle->notify.seq = (LV2_Atom_Sequence *)data;
+			break;
+		default:
+			break;
+	}
+}
+
+// rt-safe
+static LV2_Atom_Forge_Ref
+_forge_midi(generator_t *handle, LV2_Atom_Forge *forge,
+	const uint8_t *msg, uint32_t size)
+{
+	LV2_Atom_Forge_Ref ref;
+
+	if(  (ref = lv2_atom_forge_atom(forge, size, handle->urid.midi_event))
+		&& (ref = lv2_atom_forge_raw(forge, msg, size)) )
+	{
+		lv2_atom_forge_pad(forge, size);
+	}
+
+	return ref;
+}
+
+// rt-safe
+static LV2_Atom_Forge_Ref
+_forge_sysex(generator_t *handle, LV2_Atom_Forge *forge, uint32_t size)
+{
+	const uint8_t end = 0xf7;
+	LV2_Atom_Forge_Ref ref;
+
+	if(  (ref = lv2_atom_forge_atom(forge, size, handle->urid.midi_event))
+		&& (ref = lv2_atom_forge_raw(forge, handle->sysex, size - 1))
+		&& (ref = lv2_atom_forge_raw(forge, &end, 1)) )
+	{
+		lv2_atom_forge_pad(forge, size);
+	}
+
+	return ref;
+}
+
+// rt-safe
+static LV2_Atom_Forge_Ref
+_forge_bundle(generator_t *handle, LV2_Atom_Forge *forge)
+{
+	const LV2_OSC_Timetag immediate = { .integral = 0, .fraction = 1 };
+	const uint32_t r = _random(handle);
+	LV2_Atom_Forge_Frame frame [2];
+	LV2_Atom_Forge_Ref ref;
+
+	if(  (ref = lv2_osc_forge_bundle_head(forge, &handle->osc_urid, frame, &immediate))
+		&& (ref = lv2_osc_forge_message_vararg(forge, &handle->osc_urid,
+			"/sherlock/storm/xy", "ff", (r & 0xffff) / 65535.f, (r >> 16) / 65535.f))
+		&& (ref = lv2_osc_forge_message_vararg(forge, &handle->osc_urid,
+			"/sherlock/storm/state", "is", handle->counter, r & 1 ? "on" : "off")) )
+	{
+		lv2_osc_forge_pop(forge, frame);
+	}
+
+	return ref;
+}
+
+// rt-safe
+static LV2_Atom_Forge_Ref
+_forge_object(generator_t *handle, LV2_Atom_Forge *forge)
+{
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Ref ref;
+
+	if(  (ref = lv2_atom_forge_object(forge, &frame, 0, handle->urid.storm))
+		&& (ref = lv2_atom_forge_key(forge, handle->urid.counter))
+		&& (ref = lv2_atom_forge_long(forge, handle->counter))
+		&& (ref = lv2_atom_forge_key(forge, handle->urid.value))
+		&& (ref = lv2_atom_forge_float(forge, _random(handle) / (float)UINT32_MAX)) )
+	{
+		lv2_atom_forge_pop(forge, &frame);
+	}
+
+	return ref;
+}
+
+// rt-safe
+static LV2_Atom_Forge_Ref
+_forge_kind(generator_t *handle, LV2_Atom_Forge *forge, uint32_t kind)
+{
+	const uint32_t counter = handle->counter;
+
+	switch(kind)
+	{
+		case GENERATOR_NOTE:
+		{
+			// alternate note on/off walking across the keyboard
+			const uint8_t msg [3] = {
+				counter & 1 ? LV2_MIDI_MSG_NOTE_OFF : LV2_MIDI_MSG_NOTE_ON,
+				(counter >> 1) & 0x7f,
+				0x7f
+			};
+			return _forge_midi(handle, forge, msg, sizeof(msg));
+		}
+		case GENERATOR_CONTROLLER:
+		{
+			// triangle sweep of modulation wheel
+			const uint8_t value = counter & 0x80 ? 0x7f - (counter & 0x7f) : counter & 0x7f;
+			const uint8_t msg [3] = {
+				LV2_MIDI_MSG_CONTROLLER,
+				LV2_MIDI_CTL_MSB_MODWHEEL,
+				value
+			};
+			return _forge_midi(handle, forge, msg, sizeof(msg));
+		}
+		case GENERATOR_SYSEX:
+		{
+			uint32_t size = handle->state.sysex_size;
+			if(size < 2)
+				size = 2;
+			else if(size > GENERATOR_MAX_SYSEX)
+				size = GENERATOR_MAX_SYSEX;
+			return _forge_sysex(handle, forge, size);
+		}
+		case GENERATOR_MESSAGE:
+		{
+			return lv2_osc_forge_message_vararg(forge, &handle->osc_urid,
+				"/sherlock/storm", "if", counter, _random(handle) / (float)UINT32_MAX);
+		}
+		case GENERATOR_BUNDLE:
+		{
+			return _forge_bundle(handle, forge);
+		}
+		case GENERATOR_OBJECT:
+		{
+			return _forge_object(handle, forge);
+		}
+	}
+
+	return 0;
+}
+
+// rt-safe, next enabled kind in round-robin order
+static inline uint32_t
+_next_kind(generator_t *handle, uint32_t kinds)
+{
+	do {
+		handle->kind = (handle->kind + 1) % 6;
+	} while( !((1 << handle->kind) & kinds) );
+
+	return 1 << handle->kind;
+}
+
+// rt-safe
+static void
+run(LV2_Handle instance, uint32_t nsamples)
+{
+	generator_t *handle = (generator_t *)instance;
+	craft_t *event = &handle->event;
+	craft_t *notify = &handle->notify;
+
+	lv2_atom_forge_set_buffer(&event->forge, event->buf, event->seq->atom.size);
+	event->ref = lv2_atom_forge_sequence_head(&event->forge, &event->frame[0], 0);
+
+	lv2_atom_forge_set_buffer(&notify->forge, notify->buf, notify->seq->atom.size);
+	notify->ref = lv2_atom_forge_sequence_head(&notify->forge, &notify->frame[0], 0);
+
+	props_idle(&handle->props, &notify->forge, 0, &notify->ref);
+
+	LV2_ATOM_SEQUENCE_FOREACH(handle->control, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+		props_advance(&handle->props, &notify->forge, ev->time.frames, obj, &notify->ref);
+	}
+
+	const uint32_t kinds = handle->state.kinds & GENERATOR_ALL;
+	const uint32_t bytes = handle->state.bytes > 0
+		? handle->state.bytes
+		: 0;
+	uint32_t events = handle->state.events > 0
+		? handle->state.events
+		: 0;
+	if(bytes || (events > GENERATOR_MAX_EVENTS) )
+		events = GENERATOR_MAX_EVENTS;
+
+	LV2_Atom *seq = lv2_atom_forge_deref(&event->forge, event->ref);
+	const uint32_t body = event->forge.offset;
+	uint32_t written = 0;
+	bool overflow = false;
+
+	for(uint32_t i = 0; event->ref && kinds && (i < events) && (written < bytes || !bytes); i++)
+	{
+		// spread events evenly over the cycle, by count or by volume
+		const int64_t frame = bytes
+			? (uint64_t)written * nsamples / bytes
+			: (uint64_t)i * nsamples / events;
+
+		// roll back a partially forged event on overflow
+		const uint32_t offset = event->forge.offset;
+		LV2_Atom_Forge_Frame *stack = event->forge.stack;
+		const uint32_t size = seq->size;
+		LV2_Atom_Forge_Ref ref;
+
+		if(  (ref = lv2_atom_forge_frame_time(&event->forge, frame))
+			&& (ref = _forge_kind(handle, &event->forge, _next_kind(handle, kinds))) )
+		{
+			written = event->forge.offset - body;
+			handle->counter += 1;
+		}
+		else
+		{
+			event->forge.offset = offset;
+			event->forge.stack = stack;
+			seq->size = size;
+			overflow = true;
+			break;
+		}
+	}
+
+	if(event->ref)
+		lv2_atom_forge_pop(&event->forge, &event->frame[0]);
+	else
+		lv2_atom_sequence_clear(event->seq);
+
+	if(overflow && handle->log)
+		lv2_log_trace(&handle->logger, "event buffer overflow\n");
+
+	if(notify->ref)
+		lv2_atom_forge_pop(&notify->forge, &notify->frame[0]);
+	else
+		lv2_atom_sequence_clear(notify->seq);
+}
+
+static void
+cleanup(LV2_Handle instance)
+{
+	generator_t *handle = (generator_t *)instance;
+
+	free(handle);
+}
+
+static LV2_State_Status
+_state_save(LV2_Handle instance, LV2_State_Store_Function store,
+	LV2_State_Handle state, uint32_t flags,
+	const LV2_Feature *const *features)
+{
+	generator_t *handle = instance;
+
+	return props_save(&handle->props, store, state, flags, features);
+}
+
+static LV2_State_Status
+_state_restore(LV2_Handle instance, LV2_State_Retrieve_Function retrieve,
+	LV2_State_Handle state, uint32_t flags,
+	const LV2_Feature *const *features)
+{
+	generator_t *handle = instance;
+
+	return props_restore(&handle->props, retrieve, state, flags, features);
+}
+
+static const LV2_State_Interface state_iface = {
+	.save = _state_save,
+	.restore = _state_restore
+};
+
+static const void*
+extension_data(const char* uri)
+{
+	if(!strcmp(uri, LV2_STATE__interface))
+		return &state_iface;
+
+	return NULL;
+}
+
+const LV2_Descriptor generator = {
+	.URI						= SHERLOCK_GENERATOR_URI,
+	.instantiate		= instantiate,
+	.connect_port		= connect_port,
+	.activate				= NULL,
+	.run						= run,
+	.deactivate			= NULL,
+	.cleanup				= cleanup,
+	.extension_data	= extension_data
+};
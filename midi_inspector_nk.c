@@ -15,6 +15,8 @@
  * http://www.perlfoundation.org/artistic_license_2_0.
  */
 
+#include <stdio.h>
+#include <stdarg.h>
 #include <inttypes.h>
 
 #include <sherlock.h>
@@ -216,6 +218,144 @@ _shadow(struct nk_context *ctx, bool *shadow)
 	*shadow = !*shadow;
 }
 
+static inline void
+_cell(row_t *row, unsigned k, struct nk_color color, const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+
+	vsnprintf(row->midi.cells[k], sizeof(row->midi.cells[k]), fmt, args);
+	row->midi.colors[k] = color;
+
+	va_end(args);
+}
+
+void
+_midi_inspector_decode(plughandle_t *handle, item_t *itm)
+{
+	const LV2_Atom *body = &itm->event.ev.body;
+	const uint8_t *msg = LV2_ATOM_BODY_CONST(body);
+	row_t *row = _item_row(itm);
+
+	const uint8_t cmd = (msg[0] & 0xf0) == 0xf0
+		? msg[0]
+		: msg[0] & 0xf0;
+
+	const midi_msg_t *command_msg = _search_command(cmd);
+	const char *command_str = command_msg
+		? command_msg->key
+		: "Unknown";
+
+	snprintf(row->frames, sizeof(row->frames), "+%04"PRIi64, itm->event.ev.time.frames);
+	snprintf(row->size, sizeof(row->size), "%"PRIu32, body->size);
+
+	if(itm->event.repeat > 1)
+		snprintf(row->midi.command, sizeof(row->midi.command), "%s x%"PRIu32, command_str, itm->event.repeat);
+	else
+		snprintf(row->midi.command, sizeof(row->midi.command), "%s", command_str);
+
+	for(unsigned k=0; k<3; k++)
+		row->midi.cells[k][0] = '\0';
+
+	switch(cmd)
+	{
+		case LV2_MIDI_MSG_NOTE_OFF:
+			// fall-through
+		case LV2_MIDI_MSG_NOTE_ON:
+			// fall-through
+		case LV2_MIDI_MSG_NOTE_PRESSURE:
+		{
+			int8_t octave;
+			const char *key = _note(msg[1], &octave);
+
+			_cell(row, 0, cwhite, "Ch:%02"PRIu8, (msg[0] & 0x0f) + 1);
+			_cell(row, 1, cwhite, "%s%+"PRIi8, key, octave);
+			_cell(row, 2, cwhite, "%"PRIu8, msg[2]);
+		} break;
+		case LV2_MIDI_MSG_CONTROLLER:
+		{
+			const midi_msg_t *controller_msg = _search_controller(msg[1]);
+			const char *controller_str = controller_msg
+				? controller_msg->key
+				: "Unknown";
+
+			_cell(row, 0, cwhite, "Ch:%02"PRIu8, (msg[0] & 0x0f) + 1);
+			_cell(row, 1, cwhite, "%s", controller_str);
+			_cell(row, 2, cwhite, "%"PRIu8, msg[2]);
+		} break;
+		case LV2_MIDI_MSG_PGM_CHANGE:
+			// fall-through
+		case LV2_MIDI_MSG_CHANNEL_PRESSURE:
+		{
+			_cell(row, 0, cwhite, "Ch:%02"PRIu8, (msg[0] & 0x0f) + 1);
+			_cell(row, 1, cwhite, "%"PRIu8, msg[1]);
+		}	break;
+		case LV2_MIDI_MSG_BENDER:
+		{
+			const int16_t bender = (((int16_t)msg[2] << 7) | msg[1]) - 0x2000;
+
+			_cell(row, 0, cwhite, "Ch:%02"PRIu8, (msg[0] & 0x0f) + 1);
+			_cell(row, 1, cwhite, "%"PRIi16, bender);
+		}	break;
+		case LV2_MIDI_MSG_MTC_QUARTER:
+		{
+			const uint8_t msg_type = msg[1] >> 4;
+			const uint8_t msg_val = msg[1] & 0xf;
+
+			const midi_msg_t *timecode_msg = _search_timecode(msg_type);
+			const char *timecode_str = timecode_msg
+				? timecode_msg->key
+				: "Unknown";
+
+			_cell(row, 1, cwhite, "%s", timecode_str);
+			_cell(row, 2, cwhite, "%"PRIu8, msg_val);
+		} break;
+		case LV2_MIDI_MSG_SONG_POS:
+		{
+			const int16_t song_pos= (((int16_t)msg[2] << 7) | msg[1]);
+
+			_cell(row, 1, cwhite, "%"PRIu16, song_pos);
+		} break;
+		case LV2_MIDI_MSG_SONG_SELECT:
+		{
+			_cell(row, 1, cwhite, "%"PRIu8, msg[1]);
+		} break;
+		case LV2_MIDI_MSG_SYSTEM_EXCLUSIVE:
+			// fall-throuh
+		case LV2_MIDI_MSG_TUNE_REQUEST:
+			// fall-throuh
+		case LV2_MIDI_MSG_CLOCK:
+			// fall-throuh
+		case LV2_MIDI_MSG_START:
+			// fall-throuh
+		case LV2_MIDI_MSG_CONTINUE:
+			// fall-throuh
+		case LV2_MIDI_MSG_STOP:
+			// fall-throuh
+		case LV2_MIDI_MSG_ACTIVE_SENSE:
+			// fall-throuh
+		case LV2_MIDI_MSG_RESET:
+		{
+			// frame position of the last repeat
+			if(itm->event.repeat > 1)
+				_cell(row, 1, orange, "..@%"PRIi64, itm->event.last);
+		} break;
+	}
+
+	// sysex messages span over multiple lines of up to 4 bytes
+	row->hex[0][0] = '\0';
+	for(unsigned j=0; j<body->size; j+=4)
+	{
+		const unsigned rem = body->size - j;
+		const unsigned to = rem >= 4 ? 4 : rem;
+		char *tmp = row->hex[j/4];
+
+		for(unsigned i=0, ptr=0; i<to; i++, ptr+=3)
+			sprintf(&tmp[ptr], "%02"PRIX8" ", msg[j+i]);
+		tmp[to*3 - 1] = '\0';
+	}
+}
+
 void
 _midi_inspector_expose(struct nk_context *ctx, struct nk_rect wbounds, void *data)
 {
@@ -233,7 +373,7 @@ _midi_inspector_expose(struct nk_context *ctx, struct nk_rect wbounds, void *dat
 		struct nk_panel *panel = nk_window_get_panel(ctx);
 		struct nk_command_buffer *canvas = nk_window_get_canvas(ctx);
 
-		const float body_h = panel->bounds.h - 4*window_padding.y - 2*widget_h;
+		const float body_h = panel->bounds.h - 8*window_padding.y - 4*widget_h;
 		nk_layout_row_dynamic(ctx, body_h, 1);
 		nk_flags flags = NK_WINDOW_BORDER;
 		if(handle->state.follow)
@@ -245,7 +385,9 @@ _midi_inspector_expose(struct nk_context *ctx, struct nk_rect wbounds, void *dat
 			handle->shadow = false;
 		}
 		struct nk_list_view lview;
-		if(nk_list_view_begin(ctx, &lview, "Events", flags, widget_h, NK_MIN(handle->n_item, MAX_LINES)))
+		if(handle->state.stats)
+			_stats_view(handle, ctx);
+		else if(nk_list_view_begin(ctx, &lview, "Events", flags, widget_h, handle->n_item))
 		{
 			if(handle->state.follow)
 			{
@@ -255,7 +397,7 @@ _midi_inspector_expose(struct nk_context *ctx, struct nk_rect wbounds, void *dat
 			handle->shadow = lview.begin % 2 == 0;
 			for(int l = lview.begin; (l < lview.end) && (l < handle->n_item); l++)
 			{
-				item_t *itm = handle->items[l];
+				item_t *itm = _item_get(handle, l);
 
 				switch(itm->type)
 				{
@@ -281,178 +423,43 @@ _midi_inspector_expose(struct nk_context *ctx, struct nk_rect wbounds, void *dat
 						handle->shadow = false;
 					} break;
 
+					case ITEM_TYPE_MARKER:
+					{
+						_marker_view(handle, ctx, itm);
+					} break;
+
 					case ITEM_TYPE_EVENT:
 					{
-						LV2_Atom_Event *ev = &itm->event.ev;
-						const LV2_Atom *body = &ev->body;
-						const int64_t frames = ev->time.frames;
-						const uint8_t *msg = LV2_ATOM_BODY_CONST(body);
-						const uint8_t cmd = (msg[0] & 0xf0) == 0xf0
-							? msg[0]
-							: msg[0] & 0xf0;
-
-						const midi_msg_t *command_msg = _search_command(cmd);
-						const char *command_str = command_msg
-							? command_msg->key
-							: "Unknown";
-
-						char tmp [16];
+						const uint32_t size = itm->event.ev.body.size;
+						const row_t *row = _item_row(itm);
+
 						nk_layout_row_begin(ctx, NK_DYNAMIC, widget_h, 7);
 						{
 							nk_layout_row_push(ctx, 0.1);
 							_shadow(ctx, &handle->shadow);
-							nk_labelf_colored(ctx, NK_TEXT_LEFT, yellow, "+%04"PRIi64, frames);
+							nk_label_colored(ctx, row->frames, NK_TEXT_LEFT, yellow);
 
 							nk_layout_row_push(ctx, 0.2);
-							const unsigned rem = body->size;
-							const unsigned to = rem >= 4 ? 4 : rem % 4;
-							for(unsigned i=0, ptr=0; i<to; i++, ptr+=3)
-								sprintf(&tmp[ptr], "%02"PRIX8" ", msg[i]);
-							tmp[to*3 - 1] = '\0';
-							nk_label_colored(ctx, tmp, NK_TEXT_LEFT, cwhite);
+							nk_label_colored(ctx, row->hex[0], NK_TEXT_LEFT, cwhite);
 
 							nk_layout_row_push(ctx, 0.2);
-							nk_label_colored(ctx, command_str, NK_TEXT_LEFT, magenta);
+							nk_label_colored(ctx, row->midi.command, NK_TEXT_LEFT, magenta);
 
-							switch(cmd)
+							for(unsigned k=0; k<3; k++)
 							{
-								case LV2_MIDI_MSG_NOTE_OFF:
-									// fall-through
-								case LV2_MIDI_MSG_NOTE_ON:
-									// fall-through
-								case LV2_MIDI_MSG_NOTE_PRESSURE:
-								{
-									nk_layout_row_push(ctx, 0.1);
-									nk_labelf_colored(ctx, NK_TEXT_RIGHT, cwhite, "Ch:%02"PRIu8,
-										(msg[0] & 0x0f) + 1);
-
-									nk_layout_row_push(ctx, 0.2);
-									int8_t octave;
-									const char *key = _note(msg[1], &octave);
-									nk_labelf_colored(ctx, NK_TEXT_RIGHT, cwhite, "%s%+"PRIi8, key, octave);
-
-									nk_layout_row_push(ctx, 0.1);
-									nk_labelf_colored(ctx, NK_TEXT_RIGHT, cwhite, "%"PRIu8, msg[2]);
-								} break;
-								case LV2_MIDI_MSG_CONTROLLER:
-								{
-									nk_layout_row_push(ctx, 0.1);
-									nk_labelf_colored(ctx, NK_TEXT_RIGHT, cwhite, "Ch:%02"PRIu8,
-										(msg[0] & 0x0f) + 1);
-
-									const midi_msg_t *controller_msg = _search_controller(msg[1]);
-									const char *controller_str = controller_msg
-										? controller_msg->key
-										: "Unknown";
-									nk_layout_row_push(ctx, 0.2);
-									nk_label_colored(ctx, controller_str, NK_TEXT_RIGHT, cwhite);
-
-									nk_layout_row_push(ctx, 0.1);
-									nk_labelf_colored(ctx, NK_TEXT_RIGHT, cwhite, "%"PRIu8, msg[2]);
-								} break;
-								case LV2_MIDI_MSG_PGM_CHANGE:
-									// fall-through
-								case LV2_MIDI_MSG_CHANNEL_PRESSURE:
-								{
-									nk_layout_row_push(ctx, 0.1);
-									nk_labelf_colored(ctx, NK_TEXT_RIGHT, cwhite, "Ch:%02"PRIu8,
-										(msg[0] & 0x0f) + 1);
-
-									nk_layout_row_push(ctx, 0.2);
-									nk_labelf_colored(ctx, NK_TEXT_RIGHT, cwhite, "%"PRIu8, msg[1]);
-
-									nk_layout_row_push(ctx, 0.1);
-									_empty(ctx);
-								}	break;
-								case LV2_MIDI_MSG_BENDER:
-								{
-									const int16_t bender = (((int16_t)msg[2] << 7) | msg[1]) - 0x2000;
-
-									nk_layout_row_push(ctx, 0.1);
-									nk_labelf_colored(ctx, NK_TEXT_RIGHT, cwhite, "Ch:%02"PRIu8,
-										(msg[0] & 0x0f) + 1);
-
-									nk_layout_row_push(ctx, 0.2);
-									nk_labelf_colored(ctx, NK_TEXT_RIGHT, cwhite, "%"PRIi16, bender);
-
-									nk_layout_row_push(ctx, 0.1);
-									_empty(ctx);
-								}	break;
-								case LV2_MIDI_MSG_MTC_QUARTER:
-								{
-									const uint8_t msg_type = msg[1] >> 4;
-									const uint8_t msg_val = msg[1] & 0xf;
-
-									nk_layout_row_push(ctx, 0.1);
+								nk_layout_row_push(ctx, k == 1 ? 0.2 : 0.1);
+								if(row->midi.cells[k][0])
+									nk_label_colored(ctx, row->midi.cells[k], NK_TEXT_RIGHT, row->midi.colors[k]);
+								else
 									_empty(ctx);
-
-									const midi_msg_t *timecode_msg = _search_timecode(msg_type);
-									const char *timecode_str = timecode_msg
-										? timecode_msg->key
-										: "Unknown";
-									nk_layout_row_push(ctx, 0.2);
-									nk_label_colored(ctx, timecode_str, NK_TEXT_RIGHT, cwhite);
-
-									nk_layout_row_push(ctx, 0.1);
-									nk_labelf_colored(ctx, NK_TEXT_RIGHT, cwhite, "%"PRIu8, msg_val);
-								} break;
-								case LV2_MIDI_MSG_SONG_POS:
-								{
-									const int16_t song_pos= (((int16_t)msg[2] << 7) | msg[1]);
-
-									nk_layout_row_push(ctx, 0.1);
-									_empty(ctx);
-
-									nk_layout_row_push(ctx, 0.2);
-									nk_labelf_colored(ctx, NK_TEXT_RIGHT, cwhite, "%"PRIu16, song_pos);
-
-									nk_layout_row_push(ctx, 0.1);
-									_empty(ctx);
-								} break;
-								case LV2_MIDI_MSG_SONG_SELECT:
-								{
-									nk_layout_row_push(ctx, 0.1);
-									_empty(ctx);
-
-									nk_layout_row_push(ctx, 0.2);
-									nk_labelf_colored(ctx, NK_TEXT_RIGHT, cwhite, "%"PRIu8, msg[1]);
-
-									nk_layout_row_push(ctx, 0.1);
-									_empty(ctx);
-								} break;
-								case LV2_MIDI_MSG_SYSTEM_EXCLUSIVE:
-									// fall-throuh
-								case LV2_MIDI_MSG_TUNE_REQUEST:
-									// fall-throuh
-								case LV2_MIDI_MSG_CLOCK:
-									// fall-throuh
-								case LV2_MIDI_MSG_START:
-									// fall-throuh
-								case LV2_MIDI_MSG_CONTINUE:
-									// fall-throuh
-								case LV2_MIDI_MSG_STOP:
-									// fall-throuh
-								case LV2_MIDI_MSG_ACTIVE_SENSE:
-									// fall-throuh
-								case LV2_MIDI_MSG_RESET:
-								{
-									nk_layout_row_push(ctx, 0.1);
-									_empty(ctx);
-
-									nk_layout_row_push(ctx, 0.2);
-									_empty(ctx);
-
-									nk_layout_row_push(ctx, 0.1);
-									_empty(ctx);
-								} break;
 							}
 
 							nk_layout_row_push(ctx, 0.1);
-							nk_labelf_colored(ctx, NK_TEXT_RIGHT, blue, "%"PRIu32, body->size);
+							nk_label_colored(ctx, row->size, NK_TEXT_RIGHT, blue);
 						}
 						nk_layout_row_end(ctx);
 
-						for(unsigned j=4; j<body->size; j+=4)
+						for(unsigned j=4; j<size; j+=4)
 						{
 							nk_layout_row_begin(ctx, NK_DYNAMIC, widget_h, 7);
 							{
@@ -461,12 +468,7 @@ _midi_inspector_expose(struct nk_context *ctx, struct nk_rect wbounds, void *dat
 								_empty(ctx);
 
 								nk_layout_row_push(ctx, 0.2);
-								const unsigned rem = body->size - j;
-								const unsigned to = rem >= 4 ? 4 : rem % 4;
-								for(unsigned i=0, ptr=0; i<to; i++, ptr+=3)
-									sprintf(&tmp[ptr], "%02"PRIX8" ", msg[j+i]);
-								tmp[to*3 - 1] = '\0';
-								nk_label_colored(ctx, tmp, NK_TEXT_LEFT, cwhite);
+								nk_label_colored(ctx, row->hex[j/4], NK_TEXT_LEFT, cwhite);
 
 								nk_layout_row_push(ctx, 0.2);
 								_empty(ctx);
@@ -491,12 +493,12 @@ _midi_inspector_expose(struct nk_context *ctx, struct nk_rect wbounds, void *dat
 			nk_list_view_end(&lview);
 		}
 
-		const float n = 3;
+		const float n = 6;
 		const float r0 = 1.f / n;
 		const float r1 = 0.1f / 3;
 		const float r2 = r0 - r1;
-		const float footer [6] = {r1, r2, r1, r2, r1, r2};
-		nk_layout_row(ctx, NK_DYNAMIC, widget_h, 6, footer);
+		const float footer [12] = {r1, r2, r1, r2, r1, r2, r1, r2, r1, r2, r1, r2};
+		nk_layout_row(ctx, NK_DYNAMIC, widget_h, 12, footer);
 		{
 			const int32_t state_overwrite = _check(ctx, handle->state.overwrite);
 			if(state_overwrite != handle->state.overwrite)
@@ -521,16 +523,95 @@ _midi_inspector_expose(struct nk_context *ctx, struct nk_rect wbounds, void *dat
 				_set_bool(handle, handle->urid.follow, handle->state.follow);
 			}
 			nk_label(ctx, "follow", NK_TEXT_LEFT);
+
+			const int32_t state_lossless = _check(ctx, handle->state.lossless);
+			if(state_lossless != handle->state.lossless)
+			{
+				handle->state.lossless = state_lossless;
+				_set_bool(handle, handle->urid.lossless, handle->state.lossless);
+			}
+			nk_label(ctx, "lossless", NK_TEXT_LEFT);
+
+			const int32_t state_record = _check(ctx, handle->state.record);
+			if(state_record != handle->state.record)
+			{
+				handle->state.record = state_record;
+				_set_bool(handle, handle->urid.record, handle->state.record);
+			}
+			nk_label(ctx, "record", NK_TEXT_LEFT);
+
+			const int32_t state_stats = _check(ctx, handle->state.stats);
+			if(state_stats != handle->state.stats)
+			{
+				handle->state.stats = state_stats;
+				_set_bool(handle, handle->urid.stats, handle->state.stats);
+			}
+			nk_label(ctx, "stats", NK_TEXT_LEFT);
 		}
 
-		const bool max_reached = handle->n_item >= MAX_LINES;
-		nk_layout_row_dynamic(ctx, widget_h, 2);
+		nk_layout_row_dynamic(ctx, widget_h, 16);
+		for(int32_t channel = 0; channel < 0x10; channel++)
+		{
+			const int32_t mask = 1 << channel;
+			char tmp [4];
+			snprintf(tmp, sizeof(tmp), "%"PRIi32, channel + 1);
+
+			const int32_t selected = nk_select_label(ctx, tmp, NK_TEXT_CENTERED,
+				handle->state.channels & mask);
+			if(selected != !!(handle->state.channels & mask))
+			{
+				handle->state.channels ^= mask;
+				_set_int(handle, handle->urid.channels, handle->state.channels);
+			}
+		}
+
+		nk_layout_row_dynamic(ctx, widget_h, 10);
+		for(int32_t status = 0x8; status < 0x10; status++)
+		{
+			const int32_t mask = 1 << status;
+			const char *lbl = status < 0xf
+				? commands[status - 0x8].key
+				: "System";
+
+			const int32_t selected = nk_select_label(ctx, lbl, NK_TEXT_CENTERED,
+				handle->state.statuses & mask);
+			if(selected != !!(handle->state.statuses & mask))
+			{
+				handle->state.statuses ^= mask;
+				_set_int(handle, handle->urid.statuses, handle->state.statuses);
+			}
+		}
+		{
+			const int32_t range_min = nk_propertyi(ctx, "#min", 0x0, handle->state.range_min, 0x7f, 1, 1.f);
+			if(range_min != handle->state.range_min)
+			{
+				handle->state.range_min = range_min;
+				_set_int(handle, handle->urid.range_min, handle->state.range_min);
+			}
+
+			const int32_t range_max = nk_propertyi(ctx, "#max", 0x0, handle->state.range_max, 0x7f, 1, 1.f);
+			if(range_max != handle->state.range_max)
+			{
+				handle->state.range_max = range_max;
+				_set_int(handle, handle->urid.range_max, handle->state.range_max);
+			}
+		}
+
+		const bool max_reached = handle->full;
+		nk_layout_row_dynamic(ctx, widget_h, 5);
 		if(nk_button_symbol_label(ctx,
 			max_reached ? NK_SYMBOL_TRIANGLE_RIGHT: NK_SYMBOL_NONE,
 			"clear", NK_TEXT_LEFT))
 		{
 			_clear(handle);
 		}
+		if(handle->dropped || handle->skipped)
+			nk_labelf(ctx, NK_TEXT_CENTERED, "dropped: %"PRIi64" skipped: %"PRIi64,
+				handle->dropped, handle->skipped);
+		else
+			_empty(ctx);
+		_probe_view(handle, ctx);
+		_record_edit(handle, ctx);
 		nk_label(ctx, "Sherlock.lv2: "SHERLOCK_VERSION, NK_TEXT_RIGHT);
 	}
 	nk_end(ctx);
@@ -22,248 +22,170 @@
 
 #include <osc.lv2/util.h>
 
-typedef struct _handle_t handle_t;
+#define BUNDLE_DEPTH_MAX 8 // deeper nested bundles do not match
 
-struct _handle_t {
-	LV2_URID_Map *map;
-	LV2_URID_Unmap *unmap;
-	LV2_Log_Log *log;
-	LV2_Log_Logger logger;
+typedef enum _match_t {
+	MATCH_NONE = 0,
+	MATCH_SOME,
+	MATCH_ALL
+} match_t;
 
-	const LV2_Atom_Sequence *control;
-	craft_t through;
-	craft_t notify;
-
-	LV2_URID time_position;
-	LV2_URID time_frame;
-
-	LV2_OSC_URID osc_urid;
-
-	int64_t frame;
-
-	PROPS_T(props, MAX_NPROPS);
-	state_t state;
-	state_t stash;
-};
-
-static LV2_Handle
-instantiate(const LV2_Descriptor* descriptor, double rate,
-	const char *bundle_path, const LV2_Feature *const *features)
+// rt-safe, recurses into bundles
+static match_t
+_match(handle_t *handle, const LV2_Atom_Object *obj, unsigned depth)
 {
-	int i;
-	handle_t *handle = calloc(1, sizeof(handle_t));
-	if(!handle)
-		return NULL;
+	LV2_OSC_URID *osc_urid = &handle->osc_urid;
 
-	for(i=0; features[i]; i++)
-	{
-		if(!strcmp(features[i]->URI, LV2_URID__map))
-			handle->map = features[i]->data;
-		else if(!strcmp(features[i]->URI, LV2_URID__unmap))
-			handle->unmap = features[i]->data;
-		else if(!strcmp(features[i]->URI, LV2_LOG__log))
-			handle->log = features[i]->data;
-	}
+	if(  (depth > BUNDLE_DEPTH_MAX)
+		|| !lv2_atom_forge_is_object_type(&handle->notify.forge, obj->atom.type) )
+		return MATCH_NONE;
 
-	if(!handle->map || !handle->unmap)
+	if(lv2_osc_is_message_type(osc_urid, obj->body.otype))
 	{
-		fprintf(stderr, "%s: Host does not support urid:(un)map\n", descriptor->URI);
-		free(handle);
-		return NULL;
-	}
+		const LV2_Atom_String *path;
+		const LV2_Atom_Tuple *args;
 
-	if(handle->log)
-		lv2_log_logger_init(&handle->logger, handle->map, handle->log);
-
-	handle->time_position = handle->map->map(handle->map->handle, LV2_TIME__Position);
-	handle->time_frame = handle->map->map(handle->map->handle, LV2_TIME__frame);
-	lv2_osc_urid_init(&handle->osc_urid, handle->map);
+		if(  lv2_osc_message_get(osc_urid, obj, &path, &args)
+			&& osc_pattern_match(&handle->pattern, LV2_ATOM_BODY_CONST(path)) )
+			return MATCH_ALL;
+	}
+	else if(lv2_osc_is_bundle_type(osc_urid, obj->body.otype))
+	{
+		const LV2_Atom_Object *timetag;
+		const LV2_Atom_Tuple *items;
+		uint32_t nitems = 0;
+		uint32_t nall = 0;
+		uint32_t nnone = 0;
 
-	lv2_atom_forge_init(&handle->through.forge, handle->map);
-	lv2_atom_forge_init(&handle->notify.forge, handle->map);
+		if(!lv2_osc_bundle_get(osc_urid, obj, &timetag, &items))
+			return MATCH_NONE;
 
-	if(!props_init(&handle->props, descriptor->URI,
-		defs, MAX_NPROPS, &handle->state, &handle->stash,
-		handle->map, handle))
-	{
-		fprintf(stderr, "failed to allocate property structure\n");
-		free(handle);
-		return NULL;
-	}
+		LV2_ATOM_TUPLE_FOREACH(items, item)
+		{
+			const match_t match = _match(handle, (const LV2_Atom_Object *)item, depth + 1);
 
-	return handle;
-}
+			nitems += 1;
+			nall += match == MATCH_ALL;
+			nnone += match == MATCH_NONE;
+		}
 
-static void
-connect_port(LV2_Handle instance, uint32_t port, void *data)
-{
-	handle_t *handle = (handle_t *)instance;
+		if(nnone == nitems) // also for empty bundles
+			return MATCH_NONE;
 
-	switch(port)
-	{
-		case 0:
-			handle->control = (const LV2_Atom_Sequence *)data;
-			break;
-		case 1:
-			handle->through.seq = (LV2_Atom_Sequence *)data;
-			break;
-		case 2:
-			handle->notify.seq = (LV2_Atom_Sequence *)data;
-			break;
-		default:
-			break;
+		return nall == nitems
+			? MATCH_ALL
+			: MATCH_SOME;
 	}
+
+	return MATCH_NONE;
 }
 
-static void
-run(LV2_Handle instance, uint32_t nsamples)
+// rt-safe, copies bundle without the items not matching the pattern
+static LV2_Atom_Forge_Ref
+_strip(handle_t *handle, LV2_Atom_Forge *forge, const LV2_Atom_Object *obj,
+	unsigned depth)
 {
-	handle_t *handle = (handle_t *)instance;
-	craft_t *through = &handle->through;
-	craft_t *notify = &handle->notify;
-
-	uint32_t capacity = through->seq->atom.size;
-	lv2_atom_forge_set_buffer(&through->forge, through->buf, capacity);
-	through->ref = lv2_atom_forge_sequence_head(&through->forge, &through->frame[0], 0);
-
-	capacity = notify->seq->atom.size;
-	lv2_atom_forge_set_buffer(&notify->forge, notify->buf, capacity);
-	notify->ref = lv2_atom_forge_sequence_head(&notify->forge, &notify->frame[0], 0);
-
-	props_idle(&handle->props, &notify->forge, 0, &notify->ref);
-
-	LV2_ATOM_SEQUENCE_FOREACH(handle->control, ev)
+	LV2_OSC_URID *osc_urid = &handle->osc_urid;
+	const LV2_Atom_Object *timetag;
+	const LV2_Atom_Tuple *items;
+	LV2_Atom_Forge_Frame frame [2];
+	LV2_Atom_Forge_Ref ref;
+
+	lv2_osc_bundle_get(osc_urid, obj, &timetag, &items);
+
+	ref = lv2_atom_forge_object(forge, &frame[0], obj->body.id, obj->body.otype);
+	if(ref)
+		ref = lv2_atom_forge_key(forge, osc_urid->OSC_bundleTimetag);
+	if(ref)
+		ref = lv2_atom_forge_write(forge, timetag, lv2_atom_total_size(&timetag->atom));
+	if(ref)
+		ref = lv2_atom_forge_key(forge, osc_urid->OSC_bundleItems);
+	if(ref)
+		ref = lv2_atom_forge_tuple(forge, &frame[1]);
+
+	LV2_ATOM_TUPLE_FOREACH(items, item)
 	{
-		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
-		const int64_t frames = ev->time.frames;
+		const LV2_Atom_Object *itm = (const LV2_Atom_Object *)item;
 
-		// copy all events to through port
-		if(through->ref)
-			through->ref = lv2_atom_forge_frame_time(&through->forge, frames);
-		if(through->ref)
-			through->ref = lv2_atom_forge_raw(&through->forge, &obj->atom, lv2_atom_total_size(&obj->atom));
-		if(through->ref)
-			lv2_atom_forge_pad(&through->forge, obj->atom.size);
-
-		if(  !props_advance(&handle->props, &notify->forge, frames, obj, &notify->ref)
-			&& lv2_atom_forge_is_object_type(&notify->forge, obj->atom.type)
-			&& (obj->body.otype == handle->time_position) )
+		switch(_match(handle, itm, depth + 1))
 		{
-			const LV2_Atom_Long *time_frame = NULL;
-			lv2_atom_object_get(obj, handle->time_frame, &time_frame, NULL);
-			if(time_frame)
-				handle->frame = time_frame->body - frames;
+			case MATCH_NONE:
+			{
+				// strip
+			} break;
+			case MATCH_SOME:
+			{
+				if(ref)
+					ref = _strip(handle, forge, itm, depth + 1);
+			} break;
+			case MATCH_ALL:
+			{
+				if(ref)
+					ref = lv2_atom_forge_write(forge, itm, lv2_atom_total_size(&itm->atom));
+			} break;
 		}
 	}
 
-	if(through->ref)
-		lv2_atom_forge_pop(&through->forge, &through->frame[0]);
-	else
+	if(ref)
 	{
-		lv2_atom_sequence_clear(through->seq);
-
-		if(handle->log)
-			lv2_log_trace(&handle->logger, "through buffer overflow\n");
+		lv2_atom_forge_pop(forge, &frame[1]);
+		lv2_atom_forge_pop(forge, &frame[0]);
 	}
 
-	bool has_event = notify->seq->atom.size > sizeof(LV2_Atom_Sequence_Body);
+	return ref;
+}
 
-	if(notify->ref)
-		notify->ref = lv2_atom_forge_frame_time(&notify->forge, nsamples-1);
-	if(notify->ref)
-		notify->ref = lv2_atom_forge_tuple(&notify->forge, &notify->frame[1]);
-	if(notify->ref)
-		notify->ref = lv2_atom_forge_long(&notify->forge, handle->frame);
-	if(notify->ref)
-		notify->ref = lv2_atom_forge_int(&notify->forge, nsamples);
-	if(notify->ref)
-		notify->ref = lv2_atom_forge_sequence_head(&notify->forge, &notify->frame[2], 0);
+static const LV2_Atom_Event *
+_filter(handle_t *handle, const LV2_Atom_Event *ev)
+{
+	const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
 
 	// only serialize OSC events to UI
-	LV2_ATOM_SEQUENCE_FOREACH(handle->control, ev)
-	{
-		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+	if(  !lv2_atom_forge_is_object_type(&handle->notify.forge, obj->atom.type)
+		|| !lv2_osc_is_message_or_bundle_type(&handle->osc_urid, obj->body.otype) )
+		return NULL;
 
-		if(  lv2_atom_forge_is_object_type(&notify->forge, obj->atom.type)
-			&& lv2_osc_is_message_or_bundle_type(&handle->osc_urid, obj->body.otype) )
-		{
-			has_event = true;
-			if(notify->ref)
-				notify->ref = lv2_atom_forge_frame_time(&notify->forge, ev->time.frames);
-			if(notify->ref)
-				notify->ref = lv2_atom_forge_write(&notify->forge, &ev->body, sizeof(LV2_Atom) + ev->body.size);
-		}
-	}
+	if(!handle->pattern.ncode) // no pattern set
+		return ev;
 
-	if(notify->ref)
-		lv2_atom_forge_pop(&notify->forge, &notify->frame[2]);
-	if(notify->ref)
-		lv2_atom_forge_pop(&notify->forge, &notify->frame[1]);
-	if(notify->ref)
-		lv2_atom_forge_pop(&notify->forge, &notify->frame[0]);
-	else
+	switch(_match(handle, obj, 0))
 	{
-		lv2_atom_sequence_clear(notify->seq);
-
-		if(handle->log)
-			lv2_log_trace(&handle->logger, "notify buffer overflow\n");
+		case MATCH_NONE:
+		{
+			return NULL;
+		}
+		case MATCH_SOME:
+		{
+			craft_t *strip = &handle->strip;
+
+			lv2_atom_forge_set_buffer(&strip->forge, strip->buf, STRIP_SIZE);
+			if(  lv2_atom_forge_frame_time(&strip->forge, ev->time.frames)
+				&& _strip(handle, &strip->forge, obj, 0) )
+				return (const LV2_Atom_Event *)strip->buf;
+		} // fall-through, forward unstripped copy if it did not fit
+		case MATCH_ALL:
+		default:
+		{
+			return ev;
+		}
 	}
-
-	if(!has_event) // don't send anything
-		lv2_atom_sequence_clear(notify->seq);
-
-	handle->frame += nsamples;
 }
 
 static void
-cleanup(LV2_Handle instance)
+run(LV2_Handle instance, uint32_t nsamples)
 {
 	handle_t *handle = (handle_t *)instance;
 
-	free(handle);
-}
-
-static LV2_State_Status
-_state_save(LV2_Handle instance, LV2_State_Store_Function store,
-	LV2_State_Handle state, uint32_t flags,
-	const LV2_Feature *const *features)
-{
-	handle_t *handle = instance;
-
-	return props_save(&handle->props, store, state, flags, features);
-}
-
-static LV2_State_Status
-_state_restore(LV2_Handle instance, LV2_State_Retrieve_Function retrieve,
-	LV2_State_Handle state, uint32_t flags,
-	const LV2_Feature *const *features)
-{
-	handle_t *handle = instance;
-
-	return props_restore(&handle->props, retrieve, state, flags, features);
-}
-
-static const LV2_State_Interface state_iface = {
-	.save = _state_save,
-	.restore = _state_restore
-};
-
-static const void*
-extension_data(const char* uri)
-{
-	if(!strcmp(uri, LV2_STATE__interface))
-		return &state_iface;
-
-	return NULL;
+	_inspector_run(handle, nsamples, _filter, false);
 }
 
 const LV2_Descriptor osc_inspector = {
 	.URI						= SHERLOCK_OSC_INSPECTOR_URI,
-	.instantiate		= instantiate,
-	.connect_port		= connect_port,
+	.instantiate		= _inspector_instantiate,
+	.connect_port		= _inspector_connect_port,
 	.activate				= NULL,
 	.run						= run,
 	.deactivate			= NULL,
-	.cleanup				= cleanup,
-	.extension_data	= extension_data
+	.cleanup				= _inspector_cleanup,
+	.extension_data	= _inspector_extension_data
 };
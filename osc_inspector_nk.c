@@ -15,6 +15,8 @@
  * http://www.perlfoundation.org/artistic_license_2_0.
  */
 
+#include <stdio.h>
+#include <stdarg.h>
 #include <time.h>
 #include <math.h>
 #include <inttypes.h>
@@ -25,11 +27,15 @@
 
 #include <osc.lv2/util.h>
 
-typedef struct _mem_t mem_t;
+typedef struct _text_t text_t;
 
-struct _mem_t {
+// writes lines of a flattened packet, only measures without buffer
+struct _text_t {
+	uint8_t *buf;
 	size_t size;
-	char *buf;
+	size_t line; // offset of current line
+	unsigned cell; // of current line
+	uint32_t nlines;
 };
 
 static inline void
@@ -51,40 +57,95 @@ _shadow(struct nk_context *ctx, bool *shadow)
 	*shadow = !*shadow;
 }
 
+static inline line_t *
+_text_line(text_t *text)
+{
+	return (line_t *)&text->buf[text->line];
+}
+
 static inline void
-_mem_printf(mem_t *mem, const char *fmt, ...)
+_line_begin(text_t *text, float offset)
 {
-  va_list args;
-  va_start(args, fmt);
+	text->line = text->size;
+	text->cell = 0;
+	text->size += sizeof(line_t);
 
-	char *src;
-	if(vasprintf(&src, fmt, args) != -1)
-	{
-		const size_t sz = strlen(src);
+	if(text->buf)
+		_text_line(text)->offset = offset;
+}
 
-		mem->buf = realloc(mem->buf, mem->size + sz);
-		if(mem->buf)
-		{
-			char *dst = mem->buf + mem->size - 1;
+static inline void
+_line_end(text_t *text)
+{
+	text->size = _row_offset(text->size);
+	text->nlines += 1;
 
-			strncpy(dst, src, sz + 1);
-			mem->size += sz;
-		}
-		else
-			mem->size = 0;
+	if(text->buf)
+		_text_line(text)->size = text->size - text->line;
+}
+
+static inline void
+_cell_begin(text_t *text, struct nk_color color)
+{
+	if(text->buf)
+	{
+		line_t *line = _text_line(text);
 
-		free(src);
+		line->offsets[text->cell] = text->size - (text->line + sizeof(line_t));
+		line->colors[text->cell] = color;
+		text->buf[text->size] = '\0';
 	}
+}
+
+static inline void
+_cell_end(text_t *text)
+{
+	text->size += 1; // zero terminator
+	text->cell += 1;
+}
+
+static inline void
+_cell_vprintf(text_t *text, const char *fmt, va_list args)
+{
+	const int n = text->buf
+		? vsprintf((char *)&text->buf[text->size], fmt, args)
+		: vsnprintf(NULL, 0, fmt, args);
+
+	if(n > 0)
+		text->size += n;
+}
+
+static inline void
+_cell_printf(text_t *text, const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+
+	_cell_vprintf(text, fmt, args);
+
+	va_end(args);
+}
+
+// single formatted cell
+static inline void
+_cell(text_t *text, struct nk_color color, const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+
+	_cell_begin(text, color);
+	_cell_vprintf(text, fmt, args);
+	_cell_end(text);
 
 	va_end(args);
 }
 
 static void
-_osc_timetag(mem_t *mem, LV2_OSC_Timetag *tt)
+_osc_timetag(text_t *text, LV2_OSC_Timetag *tt)
 {
 	if(tt->integral <= 1UL)
 	{
-		_mem_printf(mem, "t : %s", "immediate");
+		_cell_printf(text, "t : %s", "immediate");
 	}
 	else
 	{
@@ -94,231 +155,242 @@ _osc_timetag(mem_t *mem, LV2_OSC_Timetag *tt)
 
 		char tmp [32];
 		if(strftime(tmp, 32, "%d-%b-%Y %T", ltime))
-			_mem_printf(mem, "t : %s.%06"PRIu32, tmp, us);
+			_cell_printf(text, "t : %s.%06"PRIu32, tmp, us);
 	}
 }
 
 static void
-_osc_argument(plughandle_t *handle, struct nk_context *ctx, const LV2_Atom *arg,
-	const char *path, bool first)
+_osc_argument(plughandle_t *handle, text_t *text, const LV2_Atom *arg)
 {
 	const LV2_OSC_Type type = lv2_osc_argument_type(&handle->osc_urid, arg);
 
-	mem_t mem = {
-		.size = 1,
-		.buf = calloc(1, sizeof(char))
-	};
-
 	switch(type)
 	{
 		case LV2_OSC_INT32:
 		{
 			int32_t i;
 			lv2_osc_int32_get(&handle->osc_urid, arg, &i);
-			_mem_printf(&mem, "i : %"PRIi32, i);
+			_cell_printf(text, "i : %"PRIi32, i);
 		} break;
 		case LV2_OSC_FLOAT:
 		{
 			float f;
 			lv2_osc_float_get(&handle->osc_urid, arg, &f);
-			_mem_printf(&mem, "f : %f", f);
+			_cell_printf(text, "f : %f", f);
 		} break;
 		case LV2_OSC_STRING:
 		{
 			const char *s;
 			lv2_osc_string_get(&handle->osc_urid, arg, &s);
-			_mem_printf(&mem, "s : %s", s);
+			_cell_printf(text, "s : %s", s);
 		} break;
 		case LV2_OSC_BLOB:
 		{
 			uint32_t sz;
 			const uint8_t *b;
 			lv2_osc_blob_get(&handle->osc_urid, arg, &sz, &b);
-			_mem_printf(&mem, "b : (%"PRIu32") ", sz);
+			_cell_printf(text, "b : (%"PRIu32") ", sz);
 			for(unsigned i=0; i<sz; i++)
-				_mem_printf(&mem, "%02"PRIx8, b[i]);
+				_cell_printf(text, "%02"PRIx8, b[i]);
 		} break;
 
 		case LV2_OSC_TRUE:
 		{
-			_mem_printf(&mem, "T : true");
+			_cell_printf(text, "T : true");
 		} break;
 		case LV2_OSC_FALSE:
 		{
-			_mem_printf(&mem, "F : false");
+			_cell_printf(text, "F : false");
 		} break;
 		case LV2_OSC_NIL:
 		{
-			_mem_printf(&mem, "N : nil");
+			_cell_printf(text, "N : nil");
 		} break;
 		case LV2_OSC_IMPULSE:
 		{
-			_mem_printf(&mem, "I : iimpulse");
+			_cell_printf(text, "I : iimpulse");
 		} break;
 
 		case LV2_OSC_INT64:
 		{
 			int64_t h;
 			lv2_osc_int64_get(&handle->osc_urid, arg, &h);
-			_mem_printf(&mem, "h : %"PRIi64, h);
+			_cell_printf(text, "h : %"PRIi64, h);
 		} break;
 		case LV2_OSC_DOUBLE:
 		{
 			double d;
 			lv2_osc_double_get(&handle->osc_urid, arg, &d);
-			_mem_printf(&mem, "d : %lf", d);
+			_cell_printf(text, "d : %lf", d);
 		} break;
 		case LV2_OSC_TIMETAG:
 		{
 			LV2_OSC_Timetag tt;
 			lv2_osc_timetag_get(&handle->osc_urid, arg, &tt);
-			_osc_timetag(&mem, &tt);
+			_osc_timetag(text, &tt);
 		} break;
 
 		case LV2_OSC_SYMBOL:
 		{
 			LV2_URID S;
 			lv2_osc_symbol_get(&handle->osc_urid, arg, &S);
-			_mem_printf(&mem, "S : %s", handle->unmap->unmap(handle->unmap->handle, S));
+			_cell_printf(text, "S : %s", handle->unmap->unmap(handle->unmap->handle, S));
 		} break;
 		case LV2_OSC_CHAR:
 		{
 			char c;
 			lv2_osc_char_get(&handle->osc_urid, arg, &c);
-			_mem_printf(&mem, "c : %c", c);
+			_cell_printf(text, "c : %c", c);
 		} break;
 		case LV2_OSC_RGBA:
 		{
 			uint8_t r [4];
 			lv2_osc_rgba_get(&handle->osc_urid, arg, r+0, r+1, r+2, r+3);
-			_mem_printf(&mem, "r : ");
+			_cell_printf(text, "r : ");
 			for(unsigned i=0; i<4; i++)
-				_mem_printf(&mem, "%02"PRIx8, r[i]);
+				_cell_printf(text, "%02"PRIx8, r[i]);
 		} break;
 		case LV2_OSC_MIDI:
 		{
 			uint32_t sz;
 			const uint8_t *m;
 			lv2_osc_midi_get(&handle->osc_urid, arg, &sz, &m);
-			_mem_printf(&mem, "m : (%"PRIu32") ", sz);
+			_cell_printf(text, "m : (%"PRIu32") ", sz);
 			for(unsigned i=0; i<sz; i++)
-				_mem_printf(&mem, "%02"PRIx8, m[i]);
+				_cell_printf(text, "%02"PRIx8, m[i]);
 		} break;
 	}
-
-	if(!first)
-	{
-		_shadow(ctx, &handle->shadow);
-		_empty(ctx);
-	}
-
-	if(first)
-	{
-		nk_label_colored(ctx, path, NK_TEXT_LEFT, magenta);
-	}
-	else
-	{
-		_empty(ctx);
-	}
-
-	if(mem.buf)
-	{
-		nk_label_colored(ctx, mem.buf, NK_TEXT_LEFT, cwhite);
-		free(mem.buf);
-	}
-	else
-	{
-		_empty(ctx);
-	}
-
-	nk_labelf_colored(ctx, NK_TEXT_RIGHT, blue, "%"PRIu32, arg->size);
 }
 
 static void
-_osc_message(plughandle_t *handle, struct nk_context *ctx, const LV2_Atom_Object *obj)
+_osc_message(plughandle_t *handle, text_t *text, uint32_t size,
+	const LV2_Atom_Object_Body *body, float offset)
 {
 	const LV2_Atom_String *path = NULL;
 	const LV2_Atom_Tuple *args = NULL;
-	lv2_osc_message_get(&handle->osc_urid, obj, &path, &args);
+	lv2_osc_message_body_get(&handle->osc_urid, size, body, &path, &args);
 
+	const char *path_str = path ? LV2_ATOM_BODY_CONST(path) : "";
 	bool first = true;
-	LV2_ATOM_TUPLE_FOREACH(args, arg)
+
+	if(args)
 	{
-		_osc_argument(handle, ctx, arg, LV2_ATOM_BODY_CONST(path), first);
+		LV2_ATOM_TUPLE_FOREACH(args, arg)
+		{
+			_line_begin(text, offset);
+			_cell(text, magenta, "%s", first ? path_str : "");
+
+			_cell_begin(text, cwhite);
+			_osc_argument(handle, text, arg);
+			_cell_end(text);
+
+			_cell(text, blue, "%"PRIu32, arg->size);
+			_line_end(text);
 
-		if(first)
 			first = false;
+		}
+	}
+
+	if(first) // without arguments
+	{
+		_line_begin(text, offset);
+		_cell(text, magenta, "%s", path_str);
+		_cell(text, cwhite, "%s", "");
+		_cell(text, blue, "%s", "");
+		_line_end(text);
 	}
 }
 
 static void
-_osc_packet(plughandle_t *handle, struct nk_context *ctx, int64_t frames,
-	const LV2_Atom_Object *obj, float offset);
+_osc_packet(plughandle_t *handle, text_t *text, uint32_t size,
+	const LV2_Atom_Object_Body *body, float offset);
 
 static void
-_osc_bundle(plughandle_t *handle, struct nk_context *ctx, const LV2_Atom_Object *obj, float offset)
+_osc_bundle(plughandle_t *handle, text_t *text, uint32_t size,
+	const LV2_Atom_Object_Body *body, float offset)
 {
 	const LV2_Atom_Object *timetag = NULL;
 	const LV2_Atom_Tuple *items = NULL;
-	lv2_osc_bundle_get(&handle->osc_urid, obj, &timetag, &items);
+	lv2_osc_bundle_body_get(&handle->osc_urid, size, body, &timetag, &items);
 
-	// format bundle timestamp
-	LV2_OSC_Timetag tt;
-	lv2_osc_timetag_get(&handle->osc_urid, &timetag->atom, &tt);
+	_line_begin(text, offset);
+	_cell(text, red, "#bundle");
 
-	mem_t mem = {
-		.size = 1,
-		.buf = calloc(1, sizeof(char))
-	};
+	// format bundle timestamp
+	_cell_begin(text, cwhite);
+	if(timetag)
+	{
+		LV2_OSC_Timetag tt;
+		lv2_osc_timetag_get(&handle->osc_urid, &timetag->atom, &tt);
+		_osc_timetag(text, &tt);
+	}
+	_cell_end(text);
 
-	nk_label_colored(ctx, "#bundle", NK_TEXT_LEFT, red);
+	_cell(text, blue, "%"PRIu32, size);
+	_line_end(text);
 
-	_osc_timetag(&mem, &tt);
-	if(mem.buf)
+	if(items)
 	{
-		nk_label_colored(ctx, mem.buf, NK_TEXT_LEFT, cwhite);
-		free(mem.buf);
+		LV2_ATOM_TUPLE_FOREACH(items, item)
+		{
+			const LV2_Atom_Object *obj = (const LV2_Atom_Object *)item;
+
+			_osc_packet(handle, text, obj->atom.size, &obj->body, offset + 0.025);
+		}
 	}
-	else
+}
+
+static void
+_osc_packet(plughandle_t *handle, text_t *text, uint32_t size,
+	const LV2_Atom_Object_Body *body, float offset)
+{
+	if(lv2_osc_is_message_type(&handle->osc_urid, body->otype))
 	{
-		_empty(ctx);
+		_osc_message(handle, text, size, body, offset);
 	}
-
-	nk_labelf_colored(ctx, NK_TEXT_RIGHT, blue, "%"PRIu32, obj->atom.size);
-
-	LV2_ATOM_TUPLE_FOREACH(items, item)
+	else if(lv2_osc_is_bundle_type(&handle->osc_urid, body->otype))
 	{
-		_osc_packet(handle, ctx, -1, (const LV2_Atom_Object *)item, offset + 0.025);
+		_osc_bundle(handle, text, size, body, offset);
 	}
 }
 
-static void
-_osc_packet(plughandle_t *handle, struct nk_context *ctx, int64_t frames,
-	const LV2_Atom_Object *obj, float offset)
+static inline const line_t *
+_osc_lines(const row_t *row)
 {
-	const float widget_h = handle->dy;
+	return (const line_t *)((const uint8_t *)row + sizeof(row_t));
+}
 
-	const float ratios [4] = {offset, 0.3f - offset, 0.6f, 0.1f};
-	nk_layout_row(ctx, NK_DYNAMIC, widget_h, 4, ratios);
+size_t
+_osc_inspector_size(plughandle_t *handle, uint32_t size, const void *body)
+{
+	text_t text = {
+		.buf = NULL
+	};
+
+	_osc_packet(handle, &text, size, body, 0.1);
+
+	return text.size;
+}
+
+void
+_osc_inspector_decode(plughandle_t *handle, item_t *itm)
+{
+	const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&itm->event.ev.body;
+	const int64_t frames = itm->event.ev.time.frames;
+	row_t *row = _item_row(itm);
+	text_t text = {
+		.buf = (uint8_t *)_osc_lines(row)
+	};
 
-	_shadow(ctx, &handle->shadow);
 	if(frames > 0)
-	{
-		nk_labelf_colored(ctx, NK_TEXT_LEFT, yellow, "+%04"PRIi64, frames);
-	}
+		snprintf(row->frames, sizeof(row->frames), "+%04"PRIi64, frames);
 	else
-	{
-		_empty(ctx);
-	}
+		row->frames[0] = '\0';
+	snprintf(row->size, sizeof(row->size), "%"PRIu32, obj->atom.size);
 
-	if(lv2_osc_is_message_type(&handle->osc_urid, obj->body.otype))
-	{
-		_osc_message(handle, ctx, obj);
-	}
-	else if(lv2_osc_is_bundle_type(&handle->osc_urid, obj->body.otype))
-	{
-		_osc_bundle(handle, ctx, obj, offset);
-	}
+	_osc_packet(handle, &text, obj->atom.size, &obj->body, 0.1);
+
+	row->osc.nlines = text.nlines;
 }
 
 void
@@ -338,7 +410,37 @@ _osc_inspector_expose(struct nk_context *ctx, struct nk_rect wbounds, void *data
 		struct nk_panel *panel= nk_window_get_panel(ctx);
 		struct nk_command_buffer *canvas = nk_window_get_canvas(ctx);
 
-		const float body_h = panel->bounds.h - 4*window_padding.y - 2*widget_h;
+		// has pattern been updated meanwhile ?
+		if(handle->pattern_dirty)
+		{
+			snprintf(handle->pattern_expr, sizeof(handle->pattern_expr), "%.*s",
+				(int)sizeof(handle->state.pattern), handle->state.pattern);
+			handle->pattern_error = false;
+			handle->pattern_dirty = false;
+		}
+
+		const float ratio [2] = {0.85f, 0.15f};
+		nk_layout_row(ctx, NK_DYNAMIC, widget_h, 2, ratio);
+		const nk_flags edit_flags = NK_EDIT_FIELD
+			| NK_EDIT_AUTO_SELECT
+			| NK_EDIT_SIG_ENTER;
+		const nk_flags mode = nk_edit_string_zero_terminated(ctx, edit_flags,
+			handle->pattern_expr, sizeof(handle->pattern_expr) - 1, nk_filter_ascii);
+		if(mode & NK_EDIT_COMMITED)
+		{
+			osc_pattern_t pattern;
+
+			// plugin compiles on its own, this is for feedback only
+			handle->pattern_error = osc_pattern_compile(&pattern, handle->pattern_expr) != 0;
+			if(!handle->pattern_error)
+				_set_text(handle, handle->urid.pattern, handle->pattern_expr);
+		}
+		if(handle->pattern_error)
+			nk_label_colored(ctx, "syntax error", NK_TEXT_RIGHT, nk_rgb(0xff, 0x00, 0x00));
+		else
+			nk_label(ctx, "pattern", NK_TEXT_RIGHT);
+
+		const float body_h = panel->bounds.h - 6*window_padding.y - 3*widget_h;
 		nk_layout_row_dynamic(ctx, body_h, 1);
 		nk_flags flags = NK_WINDOW_BORDER;
 		if(handle->state.follow)
@@ -350,7 +452,9 @@ _osc_inspector_expose(struct nk_context *ctx, struct nk_rect wbounds, void *data
 			handle->shadow = false;
 		}
 		struct nk_list_view lview;
-		if(nk_list_view_begin(ctx, &lview, "Events", flags, widget_h, NK_MIN(handle->n_item, MAX_LINES)))
+		if(handle->state.stats)
+			_stats_view(handle, ctx);
+		else if(nk_list_view_begin(ctx, &lview, "Events", flags, widget_h, handle->n_item))
 		{
 			if(handle->state.follow)
 			{
@@ -360,13 +464,13 @@ _osc_inspector_expose(struct nk_context *ctx, struct nk_rect wbounds, void *data
 			handle->shadow = lview.begin % 2 == 0;
 			for(int l = lview.begin; (l < lview.end) && (l < handle->n_item); l++)
 			{
-				item_t *itm = handle->items[l];
+				item_t *itm = _item_get(handle, l);
 
 				switch(itm->type)
 				{
 					case ITEM_TYPE_NONE:
 					{
-						// skip, was bundle payload
+						// skip, drawn with its event
 					} break;
 					case ITEM_TYPE_FRAME:
 					{
@@ -386,14 +490,39 @@ _osc_inspector_expose(struct nk_context *ctx, struct nk_rect wbounds, void *data
 						handle->shadow = false;
 					} break;
 
+					case ITEM_TYPE_MARKER:
+					{
+						_marker_view(handle, ctx, itm);
+					} break;
+
 					case ITEM_TYPE_EVENT:
 					{
-						LV2_Atom_Event *ev = &itm->event.ev;
-						const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
-						const int64_t frames = ev->time.frames;
-						const float offset = 0.1;
+						const row_t *row = _item_row(itm);
+						const line_t *line = _osc_lines(row);
 
-						_osc_packet(handle, ctx, frames, obj, offset);
+						for(uint32_t j = 0; j < row->osc.nlines; j++)
+						{
+							const float ratios [4] = {line->offset, 0.3f - line->offset, 0.6f, 0.1f};
+							nk_layout_row(ctx, NK_DYNAMIC, widget_h, 4, ratios);
+
+							_shadow(ctx, &handle->shadow);
+							if( (j == 0) && row->frames[0])
+								nk_label_colored(ctx, row->frames, NK_TEXT_LEFT, yellow);
+							else
+								_empty(ctx);
+
+							for(unsigned k = 0; k < 3; k++)
+							{
+								const char *cell = &line->cells[line->offsets[k]];
+
+								if(cell[0])
+									nk_label_colored(ctx, cell, k == 2 ? NK_TEXT_RIGHT : NK_TEXT_LEFT, line->colors[k]);
+								else
+									_empty(ctx);
+							}
+
+							line = (const line_t *)((const uint8_t *)line + line->size);
+						}
 					} break;
 				}
 			}
@@ -401,11 +530,11 @@ _osc_inspector_expose(struct nk_context *ctx, struct nk_rect wbounds, void *data
 			nk_list_view_end(&lview);
 		}
 
-		const float n = 3;
+		const float n = 6;
 		const float r0 = 1.f / n;
 		const float r1 = 0.1f / 3; const float r2 = r0 - r1;
-		const float footer [6] = {r1, r2, r1, r2, r1, r2};
-		nk_layout_row(ctx, NK_DYNAMIC, widget_h, 6, footer);
+		const float footer [12] = {r1, r2, r1, r2, r1, r2, r1, r2, r1, r2, r1, r2};
+		nk_layout_row(ctx, NK_DYNAMIC, widget_h, 12, footer);
 		{
 			const int32_t state_overwrite = _check(ctx, handle->state.overwrite);
 			if(state_overwrite != handle->state.overwrite)
@@ -430,16 +559,47 @@ _osc_inspector_expose(struct nk_context *ctx, struct nk_rect wbounds, void *data
 				_set_bool(handle, handle->urid.follow, handle->state.follow);
 			}
 			nk_label(ctx, "follow", NK_TEXT_LEFT);
+
+			const int32_t state_lossless = _check(ctx, handle->state.lossless);
+			if(state_lossless != handle->state.lossless)
+			{
+				handle->state.lossless = state_lossless;
+				_set_bool(handle, handle->urid.lossless, handle->state.lossless);
+			}
+			nk_label(ctx, "lossless", NK_TEXT_LEFT);
+
+			const int32_t state_record = _check(ctx, handle->state.record);
+			if(state_record != handle->state.record)
+			{
+				handle->state.record = state_record;
+				_set_bool(handle, handle->urid.record, handle->state.record);
+			}
+			nk_label(ctx, "record", NK_TEXT_LEFT);
+
+			const int32_t state_stats = _check(ctx, handle->state.stats);
+			if(state_stats != handle->state.stats)
+			{
+				handle->state.stats = state_stats;
+				_set_bool(handle, handle->urid.stats, handle->state.stats);
+			}
+			nk_label(ctx, "stats", NK_TEXT_LEFT);
 		}
 
-		const bool max_reached = handle->n_item >= MAX_LINES;
-		nk_layout_row_dynamic(ctx, widget_h, 2);
+		const bool max_reached = handle->full;
+		nk_layout_row_dynamic(ctx, widget_h, 5);
 		if(nk_button_symbol_label(ctx,
 			max_reached ? NK_SYMBOL_TRIANGLE_RIGHT: NK_SYMBOL_NONE,
 			"clear", NK_TEXT_LEFT))
 		{
 			_clear(handle);
 		}
+		if(handle->dropped || handle->skipped)
+			nk_labelf(ctx, NK_TEXT_CENTERED, "dropped: %"PRIi64" skipped: %"PRIi64,
+				handle->dropped, handle->skipped);
+		else
+			_empty(ctx);
+		_probe_view(handle, ctx);
+		_record_edit(handle, ctx);
 		nk_label(ctx, "Sherlock.lv2: "SHERLOCK_VERSION, NK_TEXT_RIGHT);
 	}
 	nk_end(ctx);
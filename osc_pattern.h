@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2015-2016 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+#ifndef _SHERLOCK_OSC_PATTERN_H
+#define _SHERLOCK_OSC_PATTERN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*****************************************************************************
+ * API START
+ *****************************************************************************/
+
+/*
+ * OSC 1.0 address patterns, e.g.
+ *
+ *   /touch/{1,2}/[xy]
+ *   /mixer/ch*[0-9]/gain
+ *
+ * are compiled into a flat token list with character sets and alternative
+ * strings stored inline, so matching needs neither allocation nor parsing.
+ * '*' and '?' and character sets never match '/'.
+ */
+
+#define OSC_PATTERN_MAX_CODE 64
+#define OSC_PATTERN_MAX_SETS 8
+#define OSC_PATTERN_MAX_POOL 256
+#define OSC_PATTERN_MAX_STEPS 0x1000 // backtracking budget per match
+
+typedef enum _osc_pattern_op_t osc_pattern_op_t;
+typedef struct _osc_pattern_instr_t osc_pattern_instr_t;
+typedef struct _osc_pattern_t osc_pattern_t;
+
+enum _osc_pattern_op_t {
+	OSC_PATTERN_OP_CHAR = 0,	// literal character
+	OSC_PATTERN_OP_ANY,				// '?'
+	OSC_PATTERN_OP_STAR,			// '*'
+	OSC_PATTERN_OP_SET,				// '[a-z]', '[!0-9]'
+	OSC_PATTERN_OP_ALT				// '{foo,bar}'
+};
+
+struct _osc_pattern_instr_t {
+	uint8_t op;
+	uint8_t count; // number of alternatives
+	uint16_t arg; // character, set index or pool offset
+};
+
+struct _osc_pattern_t {
+	uint32_t ncode; // 0 for empty pattern
+	osc_pattern_instr_t code [OSC_PATTERN_MAX_CODE];
+	uint32_t sets [OSC_PATTERN_MAX_SETS][256 / 32];
+	char pool [OSC_PATTERN_MAX_POOL]; // zero terminated alternatives
+};
+
+// rt-safe, returns 0 on success or -1 on syntax error or exhausted space
+static inline int
+osc_pattern_compile(osc_pattern_t *pat, const char *str);
+
+// rt-safe, pattern must be non-empty, paths exhausting the step budget do not match
+static inline bool
+osc_pattern_match(const osc_pattern_t *pat, const char *path);
+
+/*****************************************************************************
+ * API END
+ *****************************************************************************/
+
+static inline osc_pattern_instr_t *
+_osc_pattern_push(osc_pattern_t *pat, uint8_t op, uint16_t arg)
+{
+	if(pat->ncode >= OSC_PATTERN_MAX_CODE)
+		return NULL;
+
+	osc_pattern_instr_t *instr = &pat->code[pat->ncode++];
+	instr->op = op;
+	instr->count = 0;
+	instr->arg = arg;
+
+	return instr;
+}
+
+static inline const char *
+_osc_pattern_set(osc_pattern_t *pat, uint32_t *nsets, const char *ptr)
+{
+	if(*nsets >= OSC_PATTERN_MAX_SETS)
+		return NULL;
+
+	uint32_t *set = pat->sets[*nsets];
+	memset(set, 0x0, sizeof(pat->sets[0]));
+
+	const bool negate = *ptr == '!';
+	if(negate)
+		ptr++;
+
+	for(bool first = true; first || (*ptr != ']'); first = false)
+	{
+		if(*ptr == '\0') // unterminated
+			return NULL;
+
+		uint8_t lo = *ptr++;
+		uint8_t hi = lo;
+
+		if( (ptr[0] == '-') && ptr[1] && (ptr[1] != ']') )
+		{
+			hi = ptr[1];
+			ptr += 2;
+
+			if(hi < lo) // allow reverse ranges
+			{
+				const uint8_t tmp = lo;
+				lo = hi;
+				hi = tmp;
+			}
+		}
+
+		for(uint32_t c = lo; c <= hi; c++)
+			set[c >> 5] |= 1U << (c & 0x1f);
+	}
+
+	if(negate)
+	{
+		for(unsigned i = 0; i < 256 / 32; i++)
+			set[i] = ~set[i];
+	}
+	set[0] &= ~1U; // never match string end
+
+	return _osc_pattern_push(pat, OSC_PATTERN_OP_SET, (*nsets)++)
+		? ptr + 1
+		: NULL;
+}
+
+static inline const char *
+_osc_pattern_alt(osc_pattern_t *pat, uint32_t *npool, const char *ptr)
+{
+	osc_pattern_instr_t *instr = _osc_pattern_push(pat, OSC_PATTERN_OP_ALT, *npool);
+	if(!instr)
+		return NULL;
+
+	instr->count = 1;
+
+	for( ; *ptr != '}'; ptr++)
+	{
+		if( (*ptr == '\0') || (*npool >= OSC_PATTERN_MAX_POOL - 1) )
+			return NULL;
+
+		if(*ptr == ',')
+		{
+			if(instr->count == UINT8_MAX)
+				return NULL;
+
+			pat->pool[(*npool)++] = '\0';
+			instr->count++;
+		}
+		else
+		{
+			pat->pool[(*npool)++] = *ptr;
+		}
+	}
+
+	pat->pool[(*npool)++] = '\0';
+
+	return ptr + 1;
+}
+
+static inline int
+osc_pattern_compile(osc_pattern_t *pat, const char *str)
+{
+	uint32_t nsets = 0;
+	uint32_t npool = 0;
+
+	pat->ncode = 0;
+
+	for(const char *ptr = str; ptr && *ptr; )
+	{
+		switch(*ptr)
+		{
+			case '*':
+			{
+				// consecutive stars are redundant
+				if( (pat->ncode == 0) || (pat->code[pat->ncode - 1].op != OSC_PATTERN_OP_STAR) )
+				{
+					if(!_osc_pattern_push(pat, OSC_PATTERN_OP_STAR, 0))
+						ptr = NULL;
+				}
+				if(ptr)
+					ptr++;
+			} break;
+			case '?':
+			{
+				ptr = _osc_pattern_push(pat, OSC_PATTERN_OP_ANY, 0)
+					? ptr + 1
+					: NULL;
+			} break;
+			case '[':
+			{
+				ptr = _osc_pattern_set(pat, &nsets, ptr + 1);
+			} break;
+			case '{':
+			{
+				ptr = _osc_pattern_alt(pat, &npool, ptr + 1);
+			} break;
+			case ']':
+			case '}':
+			case ',':
+			case ' ':
+			case '#':
+			{
+				ptr = NULL; // not allowed outside of sets and alternatives
+			} break;
+			default:
+			{
+				ptr = _osc_pattern_push(pat, OSC_PATTERN_OP_CHAR, (uint8_t)*ptr)
+					? ptr + 1
+					: NULL;
+			} break;
+		}
+
+		if(!ptr)
+		{
+			pat->ncode = 0;
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static inline bool
+_osc_pattern_match(const osc_pattern_t *pat, uint32_t i, const char *path,
+	uint32_t *steps)
+{
+	for( ; i < pat->ncode; i++)
+	{
+		const osc_pattern_instr_t *instr = &pat->code[i];
+
+		if(*steps == 0) // stars and alternatives backtrack, bound the effort
+			return false;
+		*steps -= 1;
+
+		switch(instr->op)
+		{
+			case OSC_PATTERN_OP_CHAR:
+			{
+				if(*path++ != instr->arg)
+					return false;
+			} break;
+			case OSC_PATTERN_OP_ANY:
+			{
+				if( (*path == '\0') || (*path == '/') )
+					return false;
+				path++;
+			} break;
+			case OSC_PATTERN_OP_SET:
+			{
+				const uint8_t c = *path++;
+				const uint32_t *set = pat->sets[instr->arg];
+
+				if( (c == '/') || !( (set[c >> 5] >> (c & 0x1f)) & 0x1) )
+					return false;
+			} break;
+			case OSC_PATTERN_OP_ALT:
+			{
+				const char *alt = &pat->pool[instr->arg];
+
+				for(uint32_t j = 0; j < instr->count; j++)
+				{
+					const size_t len = strlen(alt);
+
+					if(!strncmp(path, alt, len) && _osc_pattern_match(pat, i + 1, path + len, steps))
+						return true;
+
+					alt += len + 1;
+				}
+			} return false;
+			case OSC_PATTERN_OP_STAR:
+			{
+				if(i + 1 == pat->ncode) // trailing star matches rest of part
+					return strchr(path, '/') == NULL;
+
+				for( ; *steps; path++)
+				{
+					if(_osc_pattern_match(pat, i + 1, path, steps))
+						return true;
+					if( (*path == '\0') || (*path == '/') )
+						return false;
+				}
+			} return false;
+		}
+	}
+
+	return *path == '\0';
+}
+
+static inline bool
+osc_pattern_match(const osc_pattern_t *pat, const char *path)
+{
+	uint32_t steps = OSC_PATTERN_MAX_STEPS;
+
+	return _osc_pattern_match(pat, 0, path, &steps);
+}
+
+#endif // _SHERLOCK_OSC_PATTERN_H
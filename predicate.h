@@ -0,0 +1,639 @@
+/*
+ * Copyright (c) 2015-2016 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _SHERLOCK_PREDICATE_H
+#define _SHERLOCK_PREDICATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "lv2/lv2plug.in/ns/ext/atom/atom.h"
+#include "lv2/lv2plug.in/ns/ext/atom/util.h"
+#include "lv2/lv2plug.in/ns/ext/atom/forge.h"
+#include "lv2/lv2plug.in/ns/ext/urid/urid.h"
+
+/*****************************************************************************
+ * API START
+ *****************************************************************************/
+
+/*
+ * Filter expressions, e.g.
+ *
+ *   otype == patch:Set && patch:property == sherlock:follow && value > 0.5
+ *
+ * are compiled by the UI into postfix byte code for a small stack machine and
+ * evaluated per event by the plugin. Identifiers left of a comparison operator
+ * look up object properties, identifiers right of it are URID constants.
+ * 'type' and 'otype' are the event's (object) type, 'value' is the patch:value
+ * property of objects or the body of primitive atoms.
+ */
+
+#define PREDICATE_MAX_CODE 64
+#define PREDICATE_MAX_STACK 16
+
+typedef enum _predicate_op_t predicate_op_t;
+typedef struct _predicate_instr_t predicate_instr_t;
+typedef struct _predicate_t predicate_t;
+typedef struct _predicate_value_t predicate_value_t;
+
+enum _predicate_op_t {
+	PREDICATE_OP_NONE = 0,
+
+	// push
+	PREDICATE_OP_TYPE,
+	PREDICATE_OP_OTYPE,
+	PREDICATE_OP_VALUE,
+	PREDICATE_OP_PROPERTY,
+	PREDICATE_OP_URID,
+	PREDICATE_OP_NUMBER,
+
+	// binary
+	PREDICATE_OP_EQ,
+	PREDICATE_OP_NE,
+	PREDICATE_OP_LT,
+	PREDICATE_OP_LE,
+	PREDICATE_OP_GT,
+	PREDICATE_OP_GE,
+	PREDICATE_OP_AND,
+	PREDICATE_OP_OR,
+
+	// unary
+	PREDICATE_OP_NOT,
+
+	PREDICATE_OP_MAX
+};
+
+struct _predicate_instr_t {
+	uint32_t op;
+	LV2_URID urid;
+	double number;
+};
+
+struct _predicate_t {
+	predicate_instr_t code [PREDICATE_MAX_CODE];
+};
+
+struct _predicate_value_t {
+	double number;
+	bool valid; // e.g. false for missing properties
+};
+
+// rt-safe, returns number of instructions of a well-formed program or 0
+static inline uint32_t
+predicate_validate(const predicate_t *pred, uint32_t size);
+
+// rt-safe, program must have been validated beforehand
+static inline bool
+predicate_eval(const predicate_t *pred, uint32_t ncode,
+	const LV2_Atom_Forge *forge, LV2_URID patch_value, const LV2_Atom *atom);
+
+// non-rt, returns size of program or -1 on syntax error
+static inline int
+predicate_compile(predicate_t *pred, const char *expr, LV2_URID_Map *map);
+
+// non-rt, returns a newly allocated expression string
+static inline char *
+predicate_decompile(const predicate_t *pred, uint32_t ncode, LV2_URID_Unmap *unmap);
+
+/*****************************************************************************
+ * API END
+ *****************************************************************************/
+
+static inline uint32_t
+predicate_validate(const predicate_t *pred, uint32_t size)
+{
+	if( (size % sizeof(predicate_instr_t)) || (size > sizeof(predicate_t)) )
+		return 0;
+
+	const uint32_t ncode = size / sizeof(predicate_instr_t);
+	uint32_t depth = 0;
+
+	for(uint32_t i = 0; i < ncode; i++)
+	{
+		const uint32_t op = pred->code[i].op;
+
+		if( (op >= PREDICATE_OP_TYPE) && (op <= PREDICATE_OP_NUMBER) )
+		{
+			if(++depth > PREDICATE_MAX_STACK)
+				return 0;
+		}
+		else if( (op >= PREDICATE_OP_EQ) && (op <= PREDICATE_OP_OR) )
+		{
+			if(depth < 2)
+				return 0;
+			depth -= 1;
+		}
+		else if(op == PREDICATE_OP_NOT)
+		{
+			if(depth < 1)
+				return 0;
+		}
+		else
+		{
+			return 0;
+		}
+	}
+
+	return depth == 1 ? ncode : 0;
+}
+
+static inline predicate_value_t
+_predicate_number(const LV2_Atom_Forge *forge, const LV2_Atom *atom)
+{
+	predicate_value_t val = { .number = 0.0, .valid = true };
+
+	if( (atom->type == forge->Int) || (atom->type == forge->Bool) )
+		val.number = ((const LV2_Atom_Int *)atom)->body;
+	else if(atom->type == forge->Long)
+		val.number = ((const LV2_Atom_Long *)atom)->body;
+	else if(atom->type == forge->Float)
+		val.number = ((const LV2_Atom_Float *)atom)->body;
+	else if(atom->type == forge->Double)
+		val.number = ((const LV2_Atom_Double *)atom)->body;
+	else if(atom->type == forge->URID)
+		val.number = ((const LV2_Atom_URID *)atom)->body;
+	else
+		val.valid = false;
+
+	return val;
+}
+
+static inline predicate_value_t
+_predicate_property(const LV2_Atom_Forge *forge, const LV2_Atom *atom, LV2_URID key)
+{
+	const predicate_value_t none = { .number = 0.0, .valid = false };
+
+	if(!lv2_atom_forge_is_object_type(forge, atom->type))
+		return none;
+
+	LV2_ATOM_OBJECT_FOREACH((const LV2_Atom_Object *)atom, prop)
+	{
+		if(prop->key == key)
+			return _predicate_number(forge, &prop->value);
+	}
+
+	return none;
+}
+
+static inline bool
+predicate_eval(const predicate_t *pred, uint32_t ncode,
+	const LV2_Atom_Forge *forge, LV2_URID patch_value, const LV2_Atom *atom)
+{
+	predicate_value_t stack [PREDICATE_MAX_STACK];
+	predicate_value_t *top = stack - 1;
+	const bool is_object = lv2_atom_forge_is_object_type(forge, atom->type);
+
+	for(const predicate_instr_t *instr = pred->code; instr < pred->code + ncode; instr++)
+	{
+		switch((predicate_op_t)instr->op)
+		{
+			case PREDICATE_OP_TYPE:
+			{
+				*++top = (predicate_value_t){ .number = atom->type, .valid = true };
+			} break;
+			case PREDICATE_OP_OTYPE:
+			{
+				*++top = (predicate_value_t){
+					.number = is_object ? ((const LV2_Atom_Object *)atom)->body.otype : 0,
+					.valid = is_object };
+			} break;
+			case PREDICATE_OP_VALUE:
+			{
+				*++top = is_object
+					? _predicate_property(forge, atom, patch_value)
+					: _predicate_number(forge, atom);
+			} break;
+			case PREDICATE_OP_PROPERTY:
+			{
+				*++top = _predicate_property(forge, atom, instr->urid);
+			} break;
+			case PREDICATE_OP_URID:
+			{
+				*++top = (predicate_value_t){ .number = instr->urid, .valid = true };
+			} break;
+			case PREDICATE_OP_NUMBER:
+			{
+				*++top = (predicate_value_t){ .number = instr->number, .valid = true };
+			} break;
+
+			case PREDICATE_OP_EQ:
+			case PREDICATE_OP_NE:
+			case PREDICATE_OP_LT:
+			case PREDICATE_OP_LE:
+			case PREDICATE_OP_GT:
+			case PREDICATE_OP_GE:
+			{
+				const predicate_value_t b = *top--;
+				const predicate_value_t a = *top;
+				bool res;
+
+				switch((predicate_op_t)instr->op)
+				{
+					case PREDICATE_OP_EQ: res = a.number == b.number; break;
+					case PREDICATE_OP_NE: res = a.number != b.number; break;
+					case PREDICATE_OP_LT: res = a.number < b.number; break;
+					case PREDICATE_OP_LE: res = a.number <= b.number; break;
+					case PREDICATE_OP_GT: res = a.number > b.number; break;
+					default: res = a.number >= b.number; break;
+				}
+
+				// comparisons against missing values never hold
+				*top = (predicate_value_t){ .number = a.valid && b.valid && res, .valid = true };
+			} break;
+			case PREDICATE_OP_AND:
+			{
+				const predicate_value_t b = *top--;
+				const predicate_value_t a = *top;
+
+				*top = (predicate_value_t){
+					.number = (a.valid && a.number) && (b.valid && b.number), .valid = true };
+			} break;
+			case PREDICATE_OP_OR:
+			{
+				const predicate_value_t b = *top--;
+				const predicate_value_t a = *top;
+
+				*top = (predicate_value_t){
+					.number = (a.valid && a.number) || (b.valid && b.number), .valid = true };
+			} break;
+			case PREDICATE_OP_NOT:
+			{
+				*top = (predicate_value_t){ .number = !(top->valid && top->number), .valid = true };
+			} break;
+
+			case PREDICATE_OP_NONE:
+			case PREDICATE_OP_MAX:
+				break; // rejected by validation
+		}
+	}
+
+	return top->valid && top->number;
+}
+
+typedef struct _predicate_parser_t predicate_parser_t;
+
+struct _predicate_parser_t {
+	const char *ptr;
+	predicate_t *pred;
+	uint32_t ncode;
+	LV2_URID_Map *map;
+	bool error;
+};
+
+static const struct {
+	const char *prefix;
+	const char *uri;
+} _predicate_prefixes [] = {
+	{ "rdf:", "http://www.w3.org/1999/02/22-rdf-syntax-ns#" },
+	{ "rdfs:", "http://www.w3.org/2000/01/rdf-schema#" },
+	{ "xsd:", "http://www.w3.org/2001/XMLSchema#" },
+	{ "lv2:", "http://lv2plug.in/ns/lv2core#" },
+	{ "atom:", "http://lv2plug.in/ns/ext/atom#" },
+	{ "midi:", "http://lv2plug.in/ns/ext/midi#" },
+	{ "time:", "http://lv2plug.in/ns/ext/time#" },
+	{ "patch:", "http://lv2plug.in/ns/ext/patch#" },
+	{ "units:", "http://lv2plug.in/ns/extensions/units#" },
+	{ "osc:", "http://open-music-kontrollers.ch/lv2/osc#" },
+	{ "xpress:", "http://open-music-kontrollers.ch/lv2/xpress#" },
+	{ "sherlock:", "http://open-music-kontrollers.ch/lv2/sherlock#" },
+	{ NULL, NULL }
+};
+
+static inline void
+_predicate_skip(predicate_parser_t *parser)
+{
+	while(isspace(*parser->ptr))
+		parser->ptr++;
+}
+
+static inline bool
+_predicate_accept(predicate_parser_t *parser, const char *token)
+{
+	const size_t len = strlen(token);
+
+	_predicate_skip(parser);
+	if(strncmp(parser->ptr, token, len))
+		return false;
+
+	parser->ptr += len;
+	return true;
+}
+
+static inline void
+_predicate_emit(predicate_parser_t *parser, predicate_op_t op, LV2_URID urid, double number)
+{
+	if(parser->ncode >= PREDICATE_MAX_CODE)
+	{
+		parser->error = true;
+		return;
+	}
+
+	predicate_instr_t *instr = &parser->pred->code[parser->ncode++];
+	instr->op = op;
+	instr->urid = urid;
+	instr->number = number;
+}
+
+static inline LV2_URID
+_predicate_urid(predicate_parser_t *parser, const char *ident, size_t len)
+{
+	char uri [1024];
+
+	for(unsigned i = 0; _predicate_prefixes[i].prefix; i++)
+	{
+		const char *prefix = _predicate_prefixes[i].prefix;
+		const size_t prefix_len = strlen(prefix);
+
+		if( (len > prefix_len) && !strncmp(ident, prefix, prefix_len) )
+		{
+			snprintf(uri, sizeof(uri), "%s%.*s", _predicate_prefixes[i].uri,
+				(int)(len - prefix_len), ident + prefix_len);
+
+			return parser->map->map(parser->map->handle, uri);
+		}
+	}
+
+	snprintf(uri, sizeof(uri), "%.*s", (int)len, ident);
+
+	return parser->map->map(parser->map->handle, uri);
+}
+
+static inline void
+_predicate_operand(predicate_parser_t *parser, bool is_key)
+{
+	_predicate_skip(parser);
+
+	const char *ptr = parser->ptr;
+	char *end = NULL;
+
+	if(*ptr == '<') // full URI
+	{
+		const char *close = strchr(ptr, '>');
+		if(!close)
+		{
+			parser->error = true;
+			return;
+		}
+
+		const LV2_URID urid = _predicate_urid(parser, ptr + 1, close - ptr - 1);
+		_predicate_emit(parser, is_key ? PREDICATE_OP_PROPERTY : PREDICATE_OP_URID, urid, 0.0);
+		parser->ptr = close + 1;
+	}
+	else if(isalpha(*ptr) || (*ptr == '_'))
+	{
+		while(isalnum(*ptr) || (*ptr && strchr("_:#/.-", *ptr)))
+			ptr++;
+
+		const size_t len = ptr - parser->ptr;
+
+		if( (len == 4) && !strncmp(parser->ptr, "type", len) )
+			_predicate_emit(parser, PREDICATE_OP_TYPE, 0, 0.0);
+		else if( (len == 5) && !strncmp(parser->ptr, "otype", len) )
+			_predicate_emit(parser, PREDICATE_OP_OTYPE, 0, 0.0);
+		else if( (len == 5) && !strncmp(parser->ptr, "value", len) )
+			_predicate_emit(parser, PREDICATE_OP_VALUE, 0, 0.0);
+		else
+		{
+			const LV2_URID urid = _predicate_urid(parser, parser->ptr, len);
+			_predicate_emit(parser, is_key ? PREDICATE_OP_PROPERTY : PREDICATE_OP_URID, urid, 0.0);
+		}
+
+		parser->ptr = ptr;
+	}
+	else
+	{
+		const double number = strtod(ptr, &end);
+		if(end == ptr)
+		{
+			parser->error = true;
+			return;
+		}
+
+		_predicate_emit(parser, PREDICATE_OP_NUMBER, 0, number);
+		parser->ptr = end;
+	}
+}
+
+static inline void
+_predicate_or(predicate_parser_t *parser);
+
+static inline void
+_predicate_unary(predicate_parser_t *parser)
+{
+	static const struct {
+		const char *token;
+		predicate_op_t op;
+	} ops [] = { // longest match first
+		{ "==", PREDICATE_OP_EQ },
+		{ "!=", PREDICATE_OP_NE },
+		{ "<=", PREDICATE_OP_LE },
+		{ ">=", PREDICATE_OP_GE },
+		{ "<", PREDICATE_OP_LT },
+		{ ">", PREDICATE_OP_GT },
+		{ NULL, PREDICATE_OP_NONE }
+	};
+
+	if(parser->error)
+		return;
+
+	if(_predicate_accept(parser, "!") && (*parser->ptr != '='))
+	{
+		_predicate_unary(parser);
+		_predicate_emit(parser, PREDICATE_OP_NOT, 0, 0.0);
+		return;
+	}
+
+	if(_predicate_accept(parser, "("))
+	{
+		_predicate_or(parser);
+		if(!_predicate_accept(parser, ")"))
+			parser->error = true;
+		return;
+	}
+
+	_predicate_operand(parser, true);
+
+	for(unsigned i = 0; ops[i].token; i++)
+	{
+		if(_predicate_accept(parser, ops[i].token))
+		{
+			_predicate_operand(parser, false);
+			_predicate_emit(parser, ops[i].op, 0, 0.0);
+			break;
+		}
+	}
+}
+
+static inline void
+_predicate_and(predicate_parser_t *parser)
+{
+	_predicate_unary(parser);
+
+	while(!parser->error && _predicate_accept(parser, "&&"))
+	{
+		_predicate_unary(parser);
+		_predicate_emit(parser, PREDICATE_OP_AND, 0, 0.0);
+	}
+}
+
+static inline void
+_predicate_or(predicate_parser_t *parser)
+{
+	_predicate_and(parser);
+
+	while(!parser->error && _predicate_accept(parser, "||"))
+	{
+		_predicate_and(parser);
+		_predicate_emit(parser, PREDICATE_OP_OR, 0, 0.0);
+	}
+}
+
+static inline int
+predicate_compile(predicate_t *pred, const char *expr, LV2_URID_Map *map)
+{
+	predicate_parser_t parser = {
+		.ptr = expr,
+		.pred = pred,
+		.ncode = 0,
+		.map = map,
+		.error = false
+	};
+
+	_predicate_skip(&parser);
+	if(*parser.ptr == '\0') // empty expression disables predicate
+		return 0;
+
+	_predicate_or(&parser);
+	_predicate_skip(&parser);
+
+	if(parser.error || (*parser.ptr != '\0') )
+		return -1;
+
+	const uint32_t size = parser.ncode * sizeof(predicate_instr_t);
+
+	return predicate_validate(pred, size) ? (int)size : -1;
+}
+
+static inline char *
+_predicate_curie(LV2_URID_Unmap *unmap, LV2_URID urid)
+{
+	const char *uri = unmap->unmap(unmap->handle, urid);
+	char *str = NULL;
+
+	if(!uri)
+		return strdup("<>");
+
+	for(unsigned i = 0; _predicate_prefixes[i].prefix; i++)
+	{
+		const size_t len = strlen(_predicate_prefixes[i].uri);
+
+		if(!strncmp(uri, _predicate_prefixes[i].uri, len))
+		{
+			if(asprintf(&str, "%s%s", _predicate_prefixes[i].prefix, uri + len) == -1)
+				str = NULL;
+			return str;
+		}
+	}
+
+	if(asprintf(&str, "<%s>", uri) == -1)
+		str = NULL;
+	return str;
+}
+
+// walks postfix code backwards
+static inline char *
+_predicate_infix(const predicate_t *pred, int32_t *idx, LV2_URID_Unmap *unmap)
+{
+	static const char *tokens [PREDICATE_OP_MAX] = {
+		[PREDICATE_OP_EQ] = "==",
+		[PREDICATE_OP_NE] = "!=",
+		[PREDICATE_OP_LT] = "<",
+		[PREDICATE_OP_LE] = "<=",
+		[PREDICATE_OP_GT] = ">",
+		[PREDICATE_OP_GE] = ">=",
+		[PREDICATE_OP_AND] = "&&",
+		[PREDICATE_OP_OR] = "||"
+	};
+
+	if(*idx < 0)
+		return NULL;
+
+	const predicate_instr_t *instr = &pred->code[(*idx)--];
+	char *str = NULL;
+
+	switch((predicate_op_t)instr->op)
+	{
+		case PREDICATE_OP_TYPE:
+			return strdup("type");
+		case PREDICATE_OP_OTYPE:
+			return strdup("otype");
+		case PREDICATE_OP_VALUE:
+			return strdup("value");
+		case PREDICATE_OP_PROPERTY:
+		case PREDICATE_OP_URID:
+			return _predicate_curie(unmap, instr->urid);
+		case PREDICATE_OP_NUMBER:
+		{
+			if(asprintf(&str, "%g", instr->number) == -1)
+				str = NULL;
+			return str;
+		}
+		case PREDICATE_OP_NOT:
+		{
+			char *a = _predicate_infix(pred, idx, unmap);
+
+			if(asprintf(&str, "!(%s)", a ? a : "") == -1)
+				str = NULL;
+			free(a);
+			return str;
+		}
+		case PREDICATE_OP_NONE:
+		case PREDICATE_OP_MAX:
+			return NULL;
+		default: // binary
+		{
+			char *b = _predicate_infix(pred, idx, unmap);
+			char *a = _predicate_infix(pred, idx, unmap);
+			const bool is_logic = (instr->op == PREDICATE_OP_AND) || (instr->op == PREDICATE_OP_OR);
+
+			if(asprintf(&str, is_logic ? "(%s) %s (%s)" : "%s %s %s",
+				a ? a : "", tokens[instr->op], b ? b : "") == -1)
+			{
+				str = NULL;
+			}
+			free(a);
+			free(b);
+			return str;
+		}
+	}
+}
+
+static inline char *
+predicate_decompile(const predicate_t *pred, uint32_t ncode, LV2_URID_Unmap *unmap)
+{
+	int32_t idx = (int32_t)ncode - 1;
+
+	char *str = _predicate_infix(pred, &idx, unmap);
+
+	return str ? str : strdup("");
+}
+
+#endif // _SHERLOCK_PREDICATE_H
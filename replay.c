@@ -0,0 +1,822 @@
+/*
+ * Copyright (c) 2015-2016 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if !defined(_WIN32)
+#	include <sys/mman.h>
+#endif
+
+#include <sherlock.h>
+
+#define REPLAY_NPROPS 3
+#define REPLAY_SIZE 0x100000 // worker -> rt
+#define REPLAY_PREFETCH 0x400000 // file range paged in ahead of worker
+#define REPLAY_URID_MAX 0x100000 // file URIDs beyond are ignored
+#define REPLAY_DEPTH_MAX 32 // deeper nested atoms are dropped
+
+typedef struct _replay_state_t replay_state_t;
+typedef struct _replay_job_t replay_job_t;
+typedef struct _replay_item_t replay_item_t;
+typedef struct _replay_t replay_t;
+
+struct _replay_state_t {
+	char path [PATH_SIZE];
+	int32_t loop;
+	float speed;
+};
+
+enum {
+	REPLAY_JOB_OPEN = 0,
+	REPLAY_JOB_FILL
+};
+
+struct _replay_job_t {
+	uint32_t type;
+	int32_t loop;
+	char path [PATH_SIZE]; // REPLAY_JOB_OPEN only
+};
+
+enum {
+	REPLAY_ITEM_EVENT = 0,
+	REPLAY_ITEM_REBASE // start of file or loop, at cycle of first event, a loop carries end of previous pass
+};
+
+// header of an event handed from worker to run()
+struct _replay_item_t {
+	int64_t time; // in frames at plugin rate
+	uint32_t type;
+	uint32_t size; // of the LV2_Atom following the header
+};
+
+struct _replay_t {
+	LV2_URID_Map *map;
+	LV2_Log_Log *log;
+	LV2_Log_Logger logger;
+	LV2_Worker_Schedule *sched;
+
+	const LV2_Atom_Sequence *control;
+	craft_t event;
+	craft_t notify;
+
+	double rate;
+	double pos; // replay time in frames
+	double base; // file time at replay time zero
+	int64_t last; // file time of last event
+	double last_pos; // replay time of last event
+	bool skipping; // until next rebase, after file change
+
+	PROPS_T(props, REPLAY_NPROPS);
+	replay_state_t state;
+	replay_state_t stash;
+
+	ring_t ring;
+
+	// only ever touched by worker
+	uint8_t *file;
+	size_t file_size;
+	size_t file_off;
+	double file_ratio; // plugin rate / file rate
+	bool file_rebase;
+	bool file_loop; // pass follows an earlier one
+	int64_t file_end; // file time at end of last cycle with an event, in frames at plugin rate
+	uint32_t file_nevents; // in current pass
+	LV2_URID *urids; // file URID -> host URID
+	size_t nurids;
+	uint8_t *scratch;
+	size_t scratch_max;
+
+	uint8_t ring_buf [REPLAY_SIZE];
+};
+
+static void
+_replay_changed(void *data, int64_t frames, props_impl_t *impl);
+
+static const props_def_t replay_defs [REPLAY_NPROPS] = {
+	{
+		.property = SHERLOCK_URI"#replayPath",
+		.offset = offsetof(replay_state_t, path),
+		.type = LV2_ATOM__Path,
+		.max_size = PATH_SIZE,
+		.event_cb = _replay_changed
+	},
+	{
+		.property = SHERLOCK_URI"#loop",
+		.offset = offsetof(replay_state_t, loop),
+		.type = LV2_ATOM__Bool,
+		.event_cb = _replay_changed
+	},
+	{
+		.property = SHERLOCK_URI"#speed",
+		.offset = offsetof(replay_state_t, speed),
+		.type = LV2_ATOM__Float
+	}
+};
+
+// rt-safe
+static void
+_replay_changed(void *data, int64_t frames, props_impl_t *impl)
+{
+	replay_t *handle = data;
+	replay_job_t job = {
+		.type = REPLAY_JOB_FILL,
+		.loop = handle->state.loop
+	};
+	size_t len = 0;
+
+	if(impl->def->offset == offsetof(replay_state_t, path))
+	{
+		const size_t max_len = impl->value.size < PATH_SIZE
+			? impl->value.size
+			: PATH_SIZE - 1;
+
+		len = strnlen(handle->state.path, max_len);
+		memcpy(job.path, handle->state.path, len);
+		job.path[len] = '\0';
+		job.type = REPLAY_JOB_OPEN;
+
+		// discard whatever is left from previous file
+		handle->skipping = true;
+	}
+
+	handle->sched->schedule_work(handle->sched->handle,
+		offsetof(replay_job_t, path) + len + 1, &job);
+}
+
+static LV2_Handle
+instantiate(const LV2_Descriptor* descriptor, double rate,
+	const char *bundle_path, const LV2_Feature *const *features)
+{
+	replay_t *handle = calloc(1, sizeof(replay_t));
+	if(!handle)
+		return NULL;
+
+	for(int i=0; features[i]; i++)
+	{
+		if(!strcmp(features[i]->URI, LV2_URID__map))
+			handle->map = features[i]->data;
+		else if(!strcmp(features[i]->URI, LV2_LOG__log))
+			handle->log = features[i]->data;
+		else if(!strcmp(features[i]->URI, LV2_WORKER__schedule))
+			handle->sched = features[i]->data;
+	}
+
+	if(!handle->map)
+	{
+		fprintf(stderr, "%s: Host does not support urid:map\n", descriptor->URI);
+		free(handle);
+		return NULL;
+	}
+	if(!handle->sched)
+	{
+		fprintf(stderr, "%s: Host does not support work:schedule\n", descriptor->URI);
+		free(handle);
+		return NULL;
+	}
+
+	if(handle->log)
+		lv2_log_logger_init(&handle->logger, handle->map, handle->log);
+
+	lv2_atom_forge_init(&handle->event.forge, handle->map);
+	lv2_atom_forge_init(&handle->notify.forge, handle->map);
+
+	handle->rate = rate;
+	ring_init(&handle->ring, handle->ring_buf, REPLAY_SIZE);
+
+	handle->state.speed = handle->stash.speed = 1.f;
+
+	if(!props_init(&handle->props, descriptor->URI,
+		replay_defs, REPLAY_NPROPS, &handle->state, &handle->stash,
+		handle->map, handle))
+	{
+		fprintf(stderr, "failed to allocate property structure\n");
+		free(handle);
+		return NULL;
+	}
+
+	return handle;
+}
+
+static void
+connect_port(LV2_Handle instance, uint32_t port, void *data)
+{
+	replay_t *handle = (replay_t *)instance;
+
+	switch(port)
+	{
+		case 0:
+			handle->control = (const LV2_Atom_Sequence *)data;
+			break;
+		case 1:
+			handle->event.seq = (LV2_Atom_Sequence *)data;
+			break;
+		case 2:
+			handle->notify.seq = (LV2_Atom_Sequence *)data;
+			break;
+		default:
+			break;
+	}
+}
+
+// rt-safe, plays back events handed over by worker at their time
+static void
+run(LV2_Handle instance, uint32_t nsamples)
+{
+	replay_t *handle = (replay_t *)instance;
+	craft_t *event = &handle->event;
+	craft_t *notify = &handle->notify;
+
+	lv2_atom_forge_set_buffer(&event->forge, event->buf, event->seq->atom.size);
+	event->ref = lv2_atom_forge_sequence_head(&event->forge, &event->frame[0], 0);
+
+	lv2_atom_forge_set_buffer(&notify->forge, notify->buf, notify->seq->atom.size);
+	notify->ref = lv2_atom_forge_sequence_head(&notify->forge, &notify->frame[0], 0);
+
+	props_idle(&handle->props, &notify->forge, 0, &notify->ref);
+
+	LV2_ATOM_SEQUENCE_FOREACH(handle->control, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+
+		props_advance(&handle->props, &notify->forge, ev->time.frames, obj, &notify->ref);
+	}
+
+	const double speed = handle->state.speed > 0.f
+		? handle->state.speed
+		: 1.0;
+	const double end = handle->pos + nsamples * speed;
+	int64_t last_frame = 0;
+	bool consumed = false;
+	replay_item_t item;
+
+	while(ring_peek(&handle->ring, 0, &item, sizeof(replay_item_t)))
+	{
+		if(item.type == REPLAY_ITEM_REBASE)
+		{
+			int64_t pass_end;
+
+			// a loop starts where the previous pass ended, a file right now
+			if( (item.size == sizeof(int64_t))
+				&& ring_peek(&handle->ring, sizeof(replay_item_t), &pass_end, sizeof(int64_t)) )
+			{
+				handle->base = item.time - (pass_end - handle->base);
+			}
+			else
+			{
+				handle->base = item.time - handle->pos;
+			}
+
+			handle->last = item.time;
+			handle->skipping = false;
+		}
+		else if(!handle->skipping)
+		{
+			// discontinuity between appended sessions, continue right at last event
+			if(item.time < handle->last)
+			{
+				handle->base = item.time - (handle->last_pos > handle->pos
+					? handle->last_pos
+					: handle->pos);
+			}
+
+			const double t = item.time - handle->base;
+			if(t >= end) // not due yet
+				break;
+
+			int64_t frame = (t - handle->pos) / speed;
+			if(frame < last_frame)
+				frame = last_frame;
+			else if(frame >= nsamples)
+				frame = nsamples - 1;
+
+			const uint8_t *ptr1;
+			const uint8_t *ptr2;
+			size_t size1;
+			size_t size2;
+
+			// header and body are written at once, so this only fails on a torn ring
+			if(!ring_regions(&handle->ring, sizeof(replay_item_t), item.size,
+				&ptr1, &size1, &ptr2, &size2))
+			{
+				break;
+			}
+
+			// check first, a failing forge would take this cycle's events with it
+			const uint32_t need = sizeof(LV2_Atom_Event) + lv2_atom_pad_size(item.size);
+
+			if(event->forge.offset + need > event->forge.size)
+			{
+				if(event->forge.offset > sizeof(LV2_Atom_Sequence)) // retry next cycle
+					break;
+
+				// does not even fit into an empty port, drop it
+				if(handle->log)
+					lv2_log_trace(&handle->logger, "event too large for port\n");
+			}
+			else if(event->ref)
+			{
+				event->ref = lv2_atom_forge_frame_time(&event->forge, frame);
+				if(event->ref)
+					event->ref = lv2_atom_forge_raw(&event->forge, ptr1, size1);
+				if(event->ref && size2)
+					event->ref = lv2_atom_forge_raw(&event->forge, ptr2, size2);
+				if(event->ref)
+					lv2_atom_forge_pad(&event->forge, item.size);
+			}
+
+			handle->last = item.time;
+			handle->last_pos = t;
+			last_frame = frame;
+		}
+
+		ring_advance(&handle->ring, sizeof(replay_item_t) + item.size);
+		consumed = true;
+	}
+
+	handle->pos = end;
+
+	if(event->ref)
+		lv2_atom_forge_pop(&event->forge, &event->frame[0]);
+	else
+	{
+		lv2_atom_sequence_clear(event->seq);
+
+		if(handle->log)
+			lv2_log_trace(&handle->logger, "event buffer overflow\n");
+	}
+
+	if(notify->ref)
+		lv2_atom_forge_pop(&notify->forge, &notify->frame[0]);
+	else
+		lv2_atom_sequence_clear(notify->seq);
+
+	// let worker refill ring
+	if(consumed)
+	{
+		const replay_job_t job = {
+			.type = REPLAY_JOB_FILL,
+			.loop = handle->state.loop
+		};
+
+		handle->sched->schedule_work(handle->sched->handle,
+			offsetof(replay_job_t, path), &job);
+	}
+}
+
+// non-rt
+static void
+_replay_close(replay_t *handle)
+{
+	if(!handle->file)
+		return;
+
+#if defined(_WIN32)
+	free(handle->file);
+#else
+	munmap(handle->file, handle->file_size);
+#endif
+	handle->file = NULL;
+	handle->file_size = 0;
+}
+
+// non-rt
+static void
+_replay_open(replay_t *handle, const char *path)
+{
+	const record_header_t *hdr;
+	struct stat st;
+
+	const int fd = open(path, O_RDONLY);
+	if(fd == -1)
+	{
+		if(handle->log)
+			lv2_log_error(&handle->logger, "failed to open capture file: %s\n", path);
+		return;
+	}
+
+	if( (fstat(fd, &st) == -1) || (st.st_size < (off_t)sizeof(record_header_t)) )
+	{
+		close(fd);
+		if(handle->log)
+			lv2_log_error(&handle->logger, "invalid capture file: %s\n", path);
+		return;
+	}
+
+	handle->file_size = st.st_size;
+#if defined(_WIN32)
+	handle->file = malloc(handle->file_size);
+	if(handle->file && (read(fd, handle->file, handle->file_size) != (ssize_t)handle->file_size))
+	{
+		free(handle->file);
+		handle->file = NULL;
+	}
+#else
+	handle->file = mmap(NULL, handle->file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(handle->file == MAP_FAILED)
+		handle->file = NULL;
+	else
+		madvise(handle->file, handle->file_size, MADV_SEQUENTIAL);
+#endif
+	close(fd);
+
+	if(!handle->file)
+	{
+		if(handle->log)
+			lv2_log_error(&handle->logger, "failed to map capture file: %s\n", path);
+		return;
+	}
+
+	hdr = (const record_header_t *)handle->file;
+	if(  memcmp(hdr->magic, RECORD_MAGIC, sizeof(hdr->magic))
+		|| (hdr->version != RECORD_VERSION) )
+	{
+		if(handle->log)
+			lv2_log_error(&handle->logger, "invalid capture file: %s\n", path);
+		_replay_close(handle);
+		return;
+	}
+
+	handle->file_ratio = hdr->rate > 0.0
+		? handle->rate / hdr->rate
+		: 1.0;
+	handle->file_off = sizeof(record_header_t);
+	handle->file_rebase = true;
+	handle->file_loop = false;
+	handle->file_end = 0;
+	handle->file_nevents = 0;
+}
+
+// non-rt
+static void
+_replay_urid(replay_t *handle, const record_t *rec)
+{
+	const uint8_t *body = (const uint8_t *)(rec + 1);
+	LV2_URID urid;
+
+	if(rec->size <= sizeof(LV2_URID))
+		return;
+
+	memcpy(&urid, body, sizeof(LV2_URID));
+	const char *uri = (const char *)(body + sizeof(LV2_URID));
+
+	// table is indexed by file URID, keep it within bounds of sane hosts
+	if( (urid == 0) || (urid >= REPLAY_URID_MAX) )
+	{
+		if(handle->log)
+			lv2_log_warning(&handle->logger, "ignoring out of range URID: %"PRIu32"\n", urid);
+		return;
+	}
+
+	if( (urid >= handle->nurids) || !handle->urids)
+	{
+		const size_t n = (urid + 1) * 2;
+		LV2_URID *urids = realloc(handle->urids, n * sizeof(LV2_URID));
+
+		if(!urids)
+			return;
+
+		memset(urids + handle->nurids, 0x0, (n - handle->nurids) * sizeof(LV2_URID));
+		handle->urids = urids;
+		handle->nurids = n;
+	}
+
+	if(strnlen(uri, rec->size - sizeof(LV2_URID)) < rec->size - sizeof(LV2_URID))
+		handle->urids[urid] = handle->map->map(handle->map->handle, uri);
+}
+
+// non-rt
+static inline LV2_URID
+_replay_map(replay_t *handle, LV2_URID urid)
+{
+	return urid < handle->nurids
+		? handle->urids[urid]
+		: 0;
+}
+
+// non-rt, rewrites file URIDs to host URIDs in place, fails on malformed atoms
+static bool
+_replay_translate(replay_t *handle, LV2_Atom *atom, size_t max, unsigned depth)
+{
+	const LV2_Atom_Forge *forge = &handle->event.forge;
+
+	// nested sizes come from the file, all have to lie within the record
+	if(  (depth > REPLAY_DEPTH_MAX) || (max < sizeof(LV2_Atom))
+		|| (atom->size > max - sizeof(LV2_Atom)) )
+	{
+		return false;
+	}
+
+	const uint8_t *end = (const uint8_t *)LV2_ATOM_BODY(atom) + atom->size;
+
+	atom->type = _replay_map(handle, atom->type);
+
+	if(lv2_atom_forge_is_object_type(forge, atom->type))
+	{
+		LV2_Atom_Object *obj = (LV2_Atom_Object *)atom;
+
+		if(atom->size < sizeof(LV2_Atom_Object_Body))
+			return false;
+
+		obj->body.id = _replay_map(handle, obj->body.id);
+		obj->body.otype = _replay_map(handle, obj->body.otype);
+
+		LV2_ATOM_OBJECT_FOREACH(obj, prop)
+		{
+			const size_t rem = end - (const uint8_t *)prop;
+
+			if(rem < sizeof(LV2_Atom_Property_Body))
+				return false;
+
+			prop->key = _replay_map(handle, prop->key);
+			prop->context = _replay_map(handle, prop->context);
+			if(!_replay_translate(handle, &prop->value,
+				rem - offsetof(LV2_Atom_Property_Body, value), depth + 1))
+			{
+				return false;
+			}
+		}
+	}
+	else if(atom->type == forge->Tuple)
+	{
+		LV2_ATOM_TUPLE_FOREACH((LV2_Atom_Tuple *)atom, item)
+		{
+			if(!_replay_translate(handle, item, end - (const uint8_t *)item, depth + 1))
+				return false;
+		}
+	}
+	else if(atom->type == forge->Sequence)
+	{
+		LV2_Atom_Sequence *seq = (LV2_Atom_Sequence *)atom;
+
+		if(atom->size < sizeof(LV2_Atom_Sequence_Body))
+			return false;
+
+		seq->body.unit = _replay_map(handle, seq->body.unit);
+
+		LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+		{
+			const size_t rem = end - (const uint8_t *)ev;
+
+			if(  (rem < sizeof(LV2_Atom_Event))
+				|| !_replay_translate(handle, &ev->body, rem - offsetof(LV2_Atom_Event, body), depth + 1) )
+			{
+				return false;
+			}
+		}
+	}
+	else if(atom->type == forge->Vector)
+	{
+		LV2_Atom_Vector *vec = (LV2_Atom_Vector *)atom;
+
+		if(atom->size < sizeof(LV2_Atom_Vector_Body))
+			return false;
+
+		vec->body.child_type = _replay_map(handle, vec->body.child_type);
+
+		if(vec->body.child_type == forge->URID)
+		{
+			LV2_URID *urids = LV2_ATOM_CONTENTS(LV2_Atom_Vector, vec);
+			const uint32_t n = (vec->atom.size - sizeof(LV2_Atom_Vector_Body)) / sizeof(LV2_URID);
+
+			for(uint32_t i = 0; i < n; i++)
+				urids[i] = _replay_map(handle, urids[i]);
+		}
+	}
+	else if(atom->type == forge->URID)
+	{
+		LV2_Atom_URID *urid = (LV2_Atom_URID *)atom;
+
+		if(atom->size < sizeof(LV2_URID))
+			return false;
+
+		urid->body = _replay_map(handle, urid->body);
+	}
+
+	return true;
+}
+
+// non-rt, hands as many events over to run() as fit, then pages in the file ahead
+static void
+_replay_fill(replay_t *handle, bool loop)
+{
+	while(handle->file)
+	{
+		const record_t *rec = (const record_t *)(handle->file + handle->file_off);
+		const bool has_header = handle->file_off + sizeof(record_t) <= handle->file_size;
+		// payload must lie within the file, pad in size_t as sizes near 4 GiB wrap around
+		const size_t rec_size = has_header
+			&& (rec->size <= handle->file_size - handle->file_off - sizeof(record_t))
+			? sizeof(record_t) + (((size_t)rec->size + 7) & ~(size_t)7)
+			: 0;
+
+		if(!rec_size || (handle->file_off + rec_size > handle->file_size) ) // end of file
+		{
+			if(!loop || !handle->file_nevents)
+				break;
+
+			handle->file_off = sizeof(record_header_t);
+			handle->file_rebase = true;
+			handle->file_loop = true;
+			handle->file_nevents = 0;
+			continue;
+		}
+
+		if(rec->type == RECORD_TYPE_URID)
+		{
+			_replay_urid(handle, rec);
+		}
+		else if( (rec->type == RECORD_TYPE_EVENT) && (rec->size >= sizeof(LV2_Atom_Event)) )
+		{
+			const LV2_Atom_Event *ev = (const LV2_Atom_Event *)(rec + 1);
+			const size_t size = sizeof(LV2_Atom) + ev->body.size;
+
+			if(size <= rec->size - sizeof(ev->time))
+			{
+				// time base of pass is the cycle of its first event
+				if(handle->file_rebase)
+				{
+					const replay_item_t item = {
+						.time = rec->offset * handle->file_ratio,
+						.type = REPLAY_ITEM_REBASE,
+						.size = handle->file_loop ? sizeof(int64_t) : 0
+					};
+
+					if(!ring_write(&handle->ring, &item, sizeof(replay_item_t),
+						&handle->file_end, item.size))
+					{
+						break;
+					}
+
+					handle->file_rebase = false;
+				}
+
+				if(ring_write_space(&handle->ring) < sizeof(replay_item_t) + size)
+				{
+					if(sizeof(replay_item_t) + size <= REPLAY_SIZE)
+						break; // ring full, continue next time
+				}
+				else
+				{
+					if(size > handle->scratch_max)
+					{
+						uint8_t *scratch = realloc(handle->scratch, size);
+
+						if(!scratch)
+							break;
+
+						handle->scratch = scratch;
+						handle->scratch_max = size;
+					}
+
+					const replay_item_t item = {
+						.time = (rec->offset + ev->time.frames) * handle->file_ratio,
+						.type = REPLAY_ITEM_EVENT,
+						.size = size
+					};
+
+					memcpy(handle->scratch, &ev->body, size);
+
+					if(_replay_translate(handle, (LV2_Atom *)handle->scratch, size, 0))
+					{
+						ring_write(&handle->ring, &item, sizeof(replay_item_t), handle->scratch, size);
+						handle->file_nevents += 1;
+						handle->file_end = (rec->offset + rec->nsamples) * handle->file_ratio;
+					}
+					else if(handle->log)
+					{
+						lv2_log_warning(&handle->logger, "skipping malformed event in capture file\n");
+					}
+				}
+			}
+		}
+
+		handle->file_off += rec_size;
+	}
+
+#if !defined(_WIN32)
+	// page in what comes next, so neither worker nor disk stall later on
+	if(handle->file && (handle->file_off < handle->file_size) )
+	{
+		const size_t page = sysconf(_SC_PAGESIZE);
+		const size_t from = handle->file_off & ~(page - 1);
+		const size_t to = handle->file_off + REPLAY_PREFETCH < handle->file_size
+			? handle->file_off + REPLAY_PREFETCH
+			: handle->file_size;
+
+		madvise(handle->file + from, to - from, MADV_WILLNEED);
+	}
+#endif
+}
+
+// non-rt
+static LV2_Worker_Status
+_work(LV2_Handle instance, LV2_Worker_Respond_Function respond,
+	LV2_Worker_Respond_Handle worker, uint32_t size, const void *body)
+{
+	replay_t *handle = instance;
+	const replay_job_t *job = body;
+
+	if(size < offsetof(replay_job_t, path))
+		return LV2_WORKER_ERR_UNKNOWN;
+
+	if(job->type == REPLAY_JOB_OPEN)
+	{
+		_replay_close(handle);
+		if(job->path[0])
+			_replay_open(handle, job->path);
+	}
+
+	_replay_fill(handle, job->loop);
+
+	return LV2_WORKER_SUCCESS;
+}
+
+// rt-safe
+static LV2_Worker_Status
+_work_response(LV2_Handle instance, uint32_t size, const void *body)
+{
+	return LV2_WORKER_SUCCESS;
+}
+
+static void
+cleanup(LV2_Handle instance)
+{
+	replay_t *handle = (replay_t *)instance;
+
+	_replay_close(handle);
+
+	if(handle->urids)
+		free(handle->urids);
+	if(handle->scratch)
+		free(handle->scratch);
+	free(handle);
+}
+
+static LV2_State_Status
+_state_save(LV2_Handle instance, LV2_State_Store_Function store,
+	LV2_State_Handle state, uint32_t flags,
+	const LV2_Feature *const *features)
+{
+	replay_t *handle = instance;
+
+	return props_save(&handle->props, store, state, flags, features);
+}
+
+static LV2_State_Status
+_state_restore(LV2_Handle instance, LV2_State_Retrieve_Function retrieve,
+	LV2_State_Handle state, uint32_t flags,
+	const LV2_Feature *const *features)
+{
+	replay_t *handle = instance;
+
+	return props_restore(&handle->props, retrieve, state, flags, features);
+}
+
+static const LV2_State_Interface state_iface = {
+	.save = _state_save,
+	.restore = _state_restore
+};
+
+static const LV2_Worker_Interface work_iface = {
+	.work = _work,
+	.work_response = _work_response,
+	.end_run = NULL
+};
+
+static const void*
+extension_data(const char* uri)
+{
+	if(!strcmp(uri, LV2_STATE__interface))
+		return &state_iface;
+	else if(!strcmp(uri, LV2_WORKER__interface))
+		return &work_iface;
+
+	return NULL;
+}
+
+const LV2_Descriptor replay = {
+	.URI						= SHERLOCK_REPLAY_URI,
+	.instantiate		= instantiate,
+	.connect_port		= connect_port,
+	.activate				= NULL,
+	.run						= run,
+	.deactivate			= NULL,
+	.cleanup				= cleanup,
+	.extension_data	= extension_data
+};
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2015-2016 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _SHERLOCK_RING_H
+#define _SHERLOCK_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <string.h>
+
+/*****************************************************************************
+ * API START
+ *****************************************************************************/
+
+// single-producer single-consumer byte ring buffer on preallocated memory
+typedef struct _ring_t ring_t;
+
+struct _ring_t {
+	atomic_size_t head; // written by producer only
+	atomic_size_t tail; // written by consumer only
+	size_t mask;
+	uint8_t *buf;
+};
+
+// non-rt, size must be a power of two
+static inline void
+ring_init(ring_t *ring, uint8_t *buf, size_t size);
+
+// rt-safe, producer
+static inline size_t
+ring_write_space(ring_t *ring);
+
+// rt-safe, producer, writes both parts or nothing
+static inline bool
+ring_write(ring_t *ring, const void *a, size_t a_size, const void *b, size_t b_size);
+
+// rt-safe, consumer
+static inline size_t
+ring_read_space(ring_t *ring);
+
+// rt-safe, consumer, copies without consuming
+static inline bool
+ring_peek(ring_t *ring, size_t offset, void *dst, size_t size);
+
+// rt-safe, consumer, gets the (up to two) regions of a range without copying
+static inline bool
+ring_regions(ring_t *ring, size_t offset, size_t size,
+	const uint8_t **ptr1, size_t *size1, const uint8_t **ptr2, size_t *size2);
+
+// rt-safe, consumer
+static inline void
+ring_advance(ring_t *ring, size_t size);
+
+// rt-safe, consumer
+static inline bool
+ring_read(ring_t *ring, void *dst, size_t size);
+
+/*****************************************************************************
+ * API END
+ *****************************************************************************/
+
+static inline void
+ring_init(ring_t *ring, uint8_t *buf, size_t size)
+{
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	ring->mask = size - 1;
+	ring->buf = buf;
+}
+
+static inline size_t
+ring_write_space(ring_t *ring)
+{
+	const size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	const size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+	return ring->mask + 1 - (head - tail);
+}
+
+static inline void
+_ring_copy_in(ring_t *ring, size_t pos, const void *src, size_t size)
+{
+	const size_t idx = pos & ring->mask;
+	const size_t end = ring->mask + 1 - idx;
+
+	if(size <= end)
+	{
+		memcpy(&ring->buf[idx], src, size);
+	}
+	else // wraps around
+	{
+		memcpy(&ring->buf[idx], src, end);
+		memcpy(ring->buf, (const uint8_t *)src + end, size - end);
+	}
+}
+
+static inline bool
+ring_write(ring_t *ring, const void *a, size_t a_size, const void *b, size_t b_size)
+{
+	if(ring_write_space(ring) < a_size + b_size)
+		return false;
+
+	const size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+	_ring_copy_in(ring, head, a, a_size);
+	if(b_size)
+		_ring_copy_in(ring, head + a_size, b, b_size);
+
+	atomic_store_explicit(&ring->head, head + a_size + b_size, memory_order_release);
+
+	return true;
+}
+
+static inline size_t
+ring_read_space(ring_t *ring)
+{
+	const size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	const size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+	return head - tail;
+}
+
+static inline bool
+ring_regions(ring_t *ring, size_t offset, size_t size,
+	const uint8_t **ptr1, size_t *size1, const uint8_t **ptr2, size_t *size2)
+{
+	if(ring_read_space(ring) < offset + size)
+		return false;
+
+	const size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	const size_t idx = (tail + offset) & ring->mask;
+	const size_t end = ring->mask + 1 - idx;
+
+	*ptr1 = &ring->buf[idx];
+	*size1 = size <= end ? size : end;
+	*ptr2 = ring->buf;
+	*size2 = size - *size1;
+
+	return true;
+}
+
+static inline bool
+ring_peek(ring_t *ring, size_t offset, void *dst, size_t size)
+{
+	const uint8_t *ptr1;
+	const uint8_t *ptr2;
+	size_t size1;
+	size_t size2;
+
+	if(!ring_regions(ring, offset, size, &ptr1, &size1, &ptr2, &size2))
+		return false;
+
+	memcpy(dst, ptr1, size1);
+	if(size2)
+		memcpy((uint8_t *)dst + size1, ptr2, size2);
+
+	return true;
+}
+
+static inline void
+ring_advance(ring_t *ring, size_t size)
+{
+	const size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+	atomic_store_explicit(&ring->tail, tail + size, memory_order_release);
+}
+
+static inline bool
+ring_read(ring_t *ring, void *dst, size_t size)
+{
+	if(!ring_peek(ring, 0, dst, size))
+		return false;
+
+	ring_advance(ring, size);
+
+	return true;
+}
+
+#endif // _SHERLOCK_RING_H
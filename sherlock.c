@@ -15,8 +15,1283 @@
  * http://www.perlfoundation.org/artistic_license_2_0.
  */
 
+#include <stdlib.h>
+#include <math.h>
+
 #include <sherlock.h>
 
+static void
+_record_close(handle_t *handle);
+
+// non-rt
+static void
+_inspector_free(handle_t *handle)
+{
+	if(handle->ring_buf)
+		free(handle->ring_buf);
+	if(handle->stage_buf)
+		free(handle->stage_buf);
+	free(handle);
+}
+
+LV2_Handle
+_inspector_instantiate(const LV2_Descriptor* descriptor, double rate,
+	const char *bundle_path, const LV2_Feature *const *features)
+{
+	int i;
+	const LV2_Options_Option *opts = NULL;
+	handle_t *handle = calloc(1, sizeof(handle_t));
+	if(!handle)
+		return NULL;
+
+	for(i=0; features[i]; i++)
+	{
+		if(!strcmp(features[i]->URI, LV2_URID__map))
+			handle->map = features[i]->data;
+		else if(!strcmp(features[i]->URI, LV2_URID__unmap))
+			handle->unmap = features[i]->data;
+		else if(!strcmp(features[i]->URI, LV2_LOG__log))
+			handle->log = features[i]->data;
+		else if(!strcmp(features[i]->URI, LV2_WORKER__schedule))
+			handle->sched = features[i]->data;
+		else if(!strcmp(features[i]->URI, LV2_OPTIONS__options))
+			opts = features[i]->data;
+	}
+
+	if(!handle->map || !handle->unmap)
+	{
+		fprintf(stderr, "%s: Host does not support urid:(un)map\n", descriptor->URI);
+		free(handle);
+		return NULL;
+	}
+
+	// no event can be larger than the sequence buffer of the control port
+	handle->stage_max = STAGE_SIZE;
+	if(opts)
+	{
+		const LV2_URID sequence_size = handle->map->map(handle->map->handle,
+			LV2_BUF_SIZE__sequenceSize);
+		const LV2_URID atom_int = handle->map->map(handle->map->handle, LV2_ATOM__Int);
+
+		for(const LV2_Options_Option *opt = opts; opt->key; opt++)
+		{
+			if( (opt->key == sequence_size) && (opt->type == atom_int)
+				&& (*(const int32_t *)opt->value > 0)
+				&& (*(const int32_t *)opt->value < STAGE_SIZE) )
+			{
+				handle->stage_max = *(const int32_t *)opt->value;
+			}
+		}
+	}
+
+	// rings are only ever drained by the worker
+	const size_t ring_size = handle->sched
+		? CAPTURE_SIZE + TRICKLE_SIZE + TRACE_SIZE + RECORD_SIZE
+		: 0;
+
+	handle->stage_buf = malloc(handle->stage_max);
+	handle->ring_buf = ring_size ? malloc(ring_size) : NULL;
+	if(!handle->stage_buf || (ring_size && !handle->ring_buf) )
+	{
+		fprintf(stderr, "%s: failed to allocate buffers\n", descriptor->URI);
+		_inspector_free(handle);
+		return NULL;
+	}
+
+	if(handle->log)
+		lv2_log_logger_init(&handle->logger, handle->map, handle->log);
+
+	handle->rate = rate;
+	handle->time_position = handle->map->map(handle->map->handle, LV2_TIME__Position);
+	handle->time_frame = handle->map->map(handle->map->handle, LV2_TIME__frame);
+	handle->midi_event = handle->map->map(handle->map->handle, LV2_MIDI__MidiEvent);
+	handle->packed_midi = handle->map->map(handle->map->handle, SHERLOCK_URI"#PackedMidi");
+	lv2_osc_urid_init(&handle->osc_urid, handle->map);
+	_stats_urid_init(&handle->stats_urid, handle->map);
+	_fragment_urid_init(&handle->fragment_urid, handle->map);
+	_transport_urid_init(&handle->transport_urid, handle->map);
+
+	lv2_atom_forge_init(&handle->through.forge, handle->map);
+	lv2_atom_forge_init(&handle->notify.forge, handle->map);
+	lv2_atom_forge_init(&handle->reply.forge, handle->map);
+	handle->reply.buf = handle->reply_buf;
+	lv2_atom_forge_init(&handle->strip.forge, handle->map);
+	handle->strip.buf = handle->strip_buf;
+
+	if(handle->ring_buf)
+	{
+		uint8_t *buf = handle->ring_buf;
+
+		ring_init(&handle->capture, buf, CAPTURE_SIZE);
+		buf += CAPTURE_SIZE;
+		ring_init(&handle->trickle, buf, TRICKLE_SIZE);
+		buf += TRICKLE_SIZE;
+		ring_init(&handle->trace, buf, TRACE_SIZE);
+		buf += TRACE_SIZE;
+		ring_init(&handle->record, buf, RECORD_SIZE);
+	}
+	atomic_init(&handle->lost, 0);
+	atomic_init(&handle->trace_lost, 0);
+	atomic_init(&handle->record_lost, 0);
+
+	// let all MIDI through until default state is loaded
+	handle->state.channels = handle->stash.channels = 0xffff;
+	handle->state.statuses = handle->stash.statuses = 0xff00;
+	handle->state.range_min = handle->stash.range_min = 0x0;
+	handle->state.range_max = handle->stash.range_max = 0x7f;
+	handle->state.stats_period = handle->stash.stats_period = 32;
+	_inspector_stats_reset(handle);
+	_inspector_probe_reset(handle);
+
+	if(!props_init(&handle->props, descriptor->URI,
+		defs, MAX_NPROPS, &handle->state, &handle->stash,
+		handle->map, handle))
+	{
+		fprintf(stderr, "failed to allocate property structure\n");
+		_inspector_free(handle);
+		return NULL;
+	}
+
+	return handle;
+}
+
+void
+_inspector_connect_port(LV2_Handle instance, uint32_t port, void *data)
+{
+	handle_t *handle = (handle_t *)instance;
+
+	switch(port)
+	{
+		case 0:
+			handle->control = (const LV2_Atom_Sequence *)data;
+			break;
+		case 1:
+			handle->through.seq = (LV2_Atom_Sequence *)data;
+			break;
+		case 2:
+			handle->notify.seq = (LV2_Atom_Sequence *)data;
+			break;
+		default:
+			break;
+	}
+}
+
+void
+_inspector_cleanup(LV2_Handle instance)
+{
+	handle_t *handle = (handle_t *)instance;
+
+	_record_close(handle);
+
+	if(handle->pending)
+		free(handle->pending);
+	if(handle->record_scratch)
+		free(handle->record_scratch);
+	if(handle->record_seen)
+		free(handle->record_seen);
+	_inspector_free(handle);
+}
+
+// rt-safe
+void
+_inspector_stats_reset(handle_t *handle)
+{
+	stats_t *stats = &handle->stats;
+
+	memset(stats, 0x0, sizeof(stats_t));
+	stats->min_frames = INT64_MAX;
+	stats->max_frames = INT64_MIN;
+}
+
+// rt-safe
+static LV2_Atom_Forge_Ref
+_stats_forge(handle_t *handle, LV2_Atom_Forge *forge)
+{
+	const stats_urid_t *urid = &handle->stats_urid;
+	const stats_t *stats = &handle->stats;
+	const bool empty = stats->min_frames > stats->max_frames;
+	LV2_URID types [STATS_SIZE];
+	int32_t counts [STATS_SIZE];
+	int64_t sizes [STATS_SIZE];
+	uint32_t n = 0;
+	LV2_Atom_Forge_Frame frame;
+	LV2_Atom_Forge_Ref ref;
+
+	// pack occupied slots, lumped types go last as URID 0
+	for(uint32_t i = 0; i < STATS_SIZE; i++)
+	{
+		const stats_slot_t *slot = &stats->slots[i];
+
+		if(!slot->type)
+			continue;
+
+		types[n] = slot->type;
+		counts[n] = slot->count;
+		sizes[n] = slot->bytes;
+		n++;
+	}
+	if(stats->other && (n < STATS_SIZE) )
+	{
+		types[n] = 0;
+		counts[n] = stats->other;
+		sizes[n] = stats->other_bytes;
+		n++;
+	}
+
+	if(  (ref = lv2_atom_forge_object(forge, &frame, 0, urid->Stats))
+		&& (ref = lv2_atom_forge_key(forge, urid->offset))
+		&& (ref = lv2_atom_forge_long(forge, stats->offset))
+		&& (ref = lv2_atom_forge_key(forge, urid->period))
+		&& (ref = lv2_atom_forge_double(forge, stats->frames / handle->rate))
+		&& (ref = lv2_atom_forge_key(forge, urid->cycles))
+		&& (ref = lv2_atom_forge_int(forge, stats->cycles))
+		&& (ref = lv2_atom_forge_key(forge, urid->events))
+		&& (ref = lv2_atom_forge_long(forge, stats->events))
+		&& (ref = lv2_atom_forge_key(forge, urid->peak))
+		&& (ref = lv2_atom_forge_int(forge, stats->peak))
+		&& (ref = lv2_atom_forge_key(forge, urid->bytes))
+		&& (ref = lv2_atom_forge_long(forge, stats->bytes))
+		&& (ref = lv2_atom_forge_key(forge, urid->min_frames))
+		&& (ref = lv2_atom_forge_long(forge, empty ? 0 : stats->min_frames))
+		&& (ref = lv2_atom_forge_key(forge, urid->max_frames))
+		&& (ref = lv2_atom_forge_long(forge, empty ? 0 : stats->max_frames))
+		&& (ref = lv2_atom_forge_key(forge, urid->largest))
+		&& (ref = lv2_atom_forge_int(forge, stats->largest))
+		&& (ref = lv2_atom_forge_key(forge, urid->largest_type))
+		&& (ref = lv2_atom_forge_urid(forge, stats->largest_type))
+		&& (ref = lv2_atom_forge_key(forge, urid->types))
+		&& (ref = lv2_atom_forge_vector(forge, sizeof(LV2_URID), forge->URID, n, types))
+		&& (ref = lv2_atom_forge_key(forge, urid->counts))
+		&& (ref = lv2_atom_forge_vector(forge, sizeof(int32_t), forge->Int, n, counts))
+		&& (ref = lv2_atom_forge_key(forge, urid->sizes))
+		&& (ref = lv2_atom_forge_vector(forge, sizeof(int64_t), forge->Long, n, sizes)) )
+	{
+		lv2_atom_forge_pop(forge, &frame);
+	}
+
+	return ref;
+}
+
+// rt-safe, closes a cycle and sends the summary at the end of each period
+void
+_inspector_stats(handle_t *handle, uint32_t nsamples)
+{
+	stats_t *stats = &handle->stats;
+	craft_t *notify = &handle->notify;
+	const uint32_t period = handle->state.stats_period > 1
+		? handle->state.stats_period
+		: 1;
+
+	if(stats->cycles == 0)
+		stats->offset = handle->frame;
+
+	stats->cycles += 1;
+	stats->frames += nsamples;
+	stats->events += stats->cycle_events;
+	if(stats->cycle_events > stats->peak)
+		stats->peak = stats->cycle_events;
+	stats->cycle_events = 0;
+
+	// a full notify buffer only delays the summary
+	if( (stats->cycles < period) || !_inspector_fits(handle, STATS_ATOM_MAX, false) )
+		return;
+
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_frame_time(&notify->forge, 0);
+	if(notify->ref)
+		notify->ref = _stats_forge(handle, &notify->forge);
+
+	_inspector_stats_reset(handle);
+}
+
+// rt-safe, tops up token buckets, returns whether any budget applies
+bool
+_inspector_budget_refill(handle_t *handle, uint32_t nsamples)
+{
+	budget_t *budget = &handle->budget;
+	const state_t *state = &handle->state;
+	const double seconds = nsamples / handle->rate;
+
+	if(state->budget_events > 0)
+	{
+		const double burst = state->budget_events * BUDGET_BURST > 1.0
+			? state->budget_events * BUDGET_BURST
+			: 1.0;
+
+		budget->events += state->budget_events * seconds;
+		if(budget->events > burst)
+			budget->events = burst;
+	}
+
+	if(state->budget_bytes > 0)
+	{
+		const double burst = state->budget_bytes * BUDGET_BURST;
+
+		budget->bytes += state->budget_bytes * seconds;
+		if(budget->bytes > burst)
+			budget->bytes = burst;
+	}
+
+	return (state->budget_events > 0) || (state->budget_bytes > 0)
+		|| (state->decimate > 1);
+}
+
+// rt-safe, keeps an oversized event for sending in fragments, one at a time
+bool
+_inspector_stage(handle_t *handle, const LV2_Atom_Event *ev, uint32_t ev_size,
+	uint32_t nsamples)
+{
+	stage_t *stage = &handle->stage;
+
+	if(stage->size || (ev_size > handle->stage_max) )
+	{
+		handle->dropped += 1;
+		return false;
+	}
+
+	memcpy(handle->stage_buf, ev, ev_size);
+	stage->offset = handle->frame;
+	stage->nsamples = nsamples;
+	stage->index = 0;
+	stage->size = ev_size;
+	stage->sent = 0;
+
+	return true;
+}
+
+// rt-safe, sends next fragment of staged event, taking at most half of the port
+void
+_inspector_fragment(handle_t *handle)
+{
+	const fragment_urid_t *urid = &handle->fragment_urid;
+	stage_t *stage = &handle->stage;
+	craft_t *notify = &handle->notify;
+	LV2_Atom_Forge *forge = &notify->forge;
+	const uint32_t max_size = _inspector_capacity(handle) / 2;
+	const uint32_t reserve = handle->reply.forge.offset + _inspector_reserve(handle);
+
+	if(max_size <= FRAGMENT_OVERHEAD) // notify port has shrunk since staging
+	{
+		stage->size = 0;
+		stage->id += 1;
+		handle->dropped += 1;
+		return;
+	}
+
+	if(!notify->ref || (forge->offset + reserve + FRAGMENT_OVERHEAD >= forge->size) )
+		return; // no room left this cycle
+
+	uint32_t size = forge->size - forge->offset - reserve - FRAGMENT_OVERHEAD;
+	if(size > max_size - FRAGMENT_OVERHEAD)
+		size = max_size - FRAGMENT_OVERHEAD;
+	if(size > stage->size - stage->sent)
+		size = stage->size - stage->sent;
+
+	LV2_Atom_Forge_Frame frame;
+
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_frame_time(forge, 0);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_object(forge, &frame, 0, urid->Fragment);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_key(forge, urid->id);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_int(forge, stage->id);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_key(forge, urid->index);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_int(forge, stage->index);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_key(forge, urid->offset);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_long(forge, stage->offset);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_key(forge, urid->nsamples);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_int(forge, stage->nsamples);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_key(forge, urid->total);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_int(forge, stage->size);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_key(forge, urid->data);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_atom(forge, size, forge->Chunk);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_raw(forge, handle->stage_buf + stage->sent, size);
+	if(notify->ref)
+		lv2_atom_forge_pad(forge, size);
+	if(notify->ref)
+		lv2_atom_forge_pop(forge, &frame);
+
+	stage->sent += size;
+	stage->index += 1;
+
+	if(stage->sent == stage->size) // done
+	{
+		stage->size = 0;
+		stage->id += 1;
+	}
+}
+
+static bool
+_number(LV2_Atom_Forge *forge, const LV2_Atom *atom, double *val)
+{
+	if(!atom)
+		return false;
+
+	if(atom->type == forge->Long)
+		*val = ((const LV2_Atom_Long *)atom)->body;
+	else if(atom->type == forge->Int)
+		*val = ((const LV2_Atom_Int *)atom)->body;
+	else if(atom->type == forge->Float)
+		*val = ((const LV2_Atom_Float *)atom)->body;
+	else if(atom->type == forge->Double)
+		*val = ((const LV2_Atom_Double *)atom)->body;
+	else
+		return false;
+
+	return true;
+}
+
+// rt-safe, tracks time:Position and flags discontinuities in it
+void
+_inspector_transport(handle_t *handle, const LV2_Atom_Object *obj, int64_t frames)
+{
+	const transport_urid_t *urid = &handle->transport_urid;
+	transport_t *transport = &handle->transport;
+	craft_t *reply = &handle->reply;
+	LV2_Atom_Forge *forge = &reply->forge;
+
+	const LV2_Atom *frame = NULL;
+	const LV2_Atom *speed = NULL;
+	const LV2_Atom *bar = NULL;
+	const LV2_Atom *bar_beat = NULL;
+	const LV2_Atom *bpm = NULL;
+	lv2_atom_object_get(obj,
+		urid->frame, &frame,
+		urid->speed, &speed,
+		urid->bar, &bar,
+		urid->bar_beat, &bar_beat,
+		urid->bpm, &bpm,
+		0);
+
+	// missing properties keep their last value
+	double new_speed = transport->speed;
+	double new_bar = transport->bar;
+	_number(forge, speed, &new_speed);
+	_number(forge, bar, &new_bar);
+	_number(forge, bar_beat, &transport->bar_beat);
+	_number(forge, bpm, &transport->bpm);
+	transport->bar = new_bar;
+
+	int32_t flags = 0;
+	int64_t expected = 0;
+	int64_t reported = 0;
+
+	if(transport->valid)
+	{
+		expected = llround(transport->frame + frames*transport->speed);
+
+		if(new_speed != transport->speed)
+			flags |= TRANSPORT_SPEED;
+	}
+
+	if(frame && (frame->type == forge->Long) )
+	{
+		reported = ((const LV2_Atom_Long *)frame)->body;
+		handle->frame = reported - frames;
+
+		if(transport->valid)
+		{
+			if(reported > expected + TRANSPORT_TOLERANCE)
+				flags |= TRANSPORT_JUMP;
+			else if(reported < expected - TRANSPORT_TOLERANCE)
+				flags |= TRANSPORT_REWIND;
+		}
+
+		transport->frame = reported - frames*new_speed;
+		transport->valid = true;
+	}
+	else
+	{
+		reported = expected;
+		if(transport->valid)
+			transport->frame = expected - frames*new_speed;
+	}
+
+	transport->speed = new_speed;
+
+	if(!flags)
+		return;
+
+	// staged with the patch replies, as a notify tuple may be open
+	LV2_Atom_Forge_Frame obj_frame;
+
+	if(reply->ref)
+		reply->ref = lv2_atom_forge_frame_time(forge, frames);
+	if(reply->ref)
+		reply->ref = lv2_atom_forge_object(forge, &obj_frame, 0, urid->Discontinuity);
+	if(reply->ref)
+		reply->ref = lv2_atom_forge_key(forge, urid->flags);
+	if(reply->ref)
+		reply->ref = lv2_atom_forge_int(forge, flags);
+	if(reply->ref)
+		reply->ref = lv2_atom_forge_key(forge, urid->expected);
+	if(reply->ref)
+		reply->ref = lv2_atom_forge_long(forge, expected);
+	if(reply->ref)
+		reply->ref = lv2_atom_forge_key(forge, urid->frame);
+	if(reply->ref)
+		reply->ref = lv2_atom_forge_long(forge, reported);
+	if(reply->ref)
+		reply->ref = lv2_atom_forge_key(forge, urid->speed);
+	if(reply->ref)
+		reply->ref = lv2_atom_forge_float(forge, transport->speed);
+	if(reply->ref)
+		reply->ref = lv2_atom_forge_key(forge, urid->bar);
+	if(reply->ref)
+		reply->ref = lv2_atom_forge_long(forge, transport->bar);
+	if(reply->ref)
+		reply->ref = lv2_atom_forge_key(forge, urid->bar_beat);
+	if(reply->ref)
+		reply->ref = lv2_atom_forge_float(forge, transport->bar_beat);
+	if(reply->ref)
+		reply->ref = lv2_atom_forge_key(forge, urid->bpm);
+	if(reply->ref)
+		reply->ref = lv2_atom_forge_float(forge, transport->bpm);
+	if(reply->ref)
+		lv2_atom_forge_pop(forge, &obj_frame);
+}
+
+// rt-safe, sends the packed tuple of this cycle, space was checked while packing
+void
+_inspector_pack_flush(handle_t *handle, uint32_t nsamples)
+{
+	pack_t *pack = &handle->pack;
+	craft_t *notify = &handle->notify;
+	LV2_Atom_Forge *forge = &notify->forge;
+
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_frame_time(forge, 0);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_tuple(forge, &notify->frame[1]);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_long(forge, handle->frame);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_int(forge, nsamples);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_vector(forge, sizeof(packed_midi_t), handle->packed_midi,
+			pack->n, pack->records);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_long(forge, handle->dropped);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_long(forge, handle->skipped);
+	_inspector_probe_forge(handle);
+	if(pack->spill) // chunk is left out without long messages
+	{
+		if(notify->ref)
+			notify->ref = lv2_atom_forge_atom(forge, pack->spill, forge->Chunk);
+		if(notify->ref)
+			notify->ref = lv2_atom_forge_raw(forge, pack->spill_buf, pack->spill);
+		if(notify->ref)
+			lv2_atom_forge_pad(forge, pack->spill);
+	}
+	if(notify->ref)
+		lv2_atom_forge_pop(forge, &notify->frame[1]);
+
+	handle->dropped_sent = handle->dropped;
+	handle->skipped_sent = handle->skipped;
+
+	pack->n = 0;
+	pack->spill = 0;
+}
+
+// rt-safe, hands an event over to the worker for delivery in a later cycle
+bool
+_inspector_defer(handle_t *handle, const LV2_Atom_Event *ev, uint32_t ev_size,
+	uint32_t nsamples)
+{
+	const capture_t cap = {
+		.offset = handle->frame,
+		.nsamples = nsamples,
+		.size = ev_size
+	};
+	const uint32_t max_size = _inspector_capacity(handle);
+
+	// events which would never fit into the notify port are not deferred
+	if( (lv2_atom_pad_size(ev_size) + TUPLE_SIZE <= max_size)
+		&& ring_write(&handle->capture, &cap, sizeof(capture_t), ev, ev_size) )
+	{
+		handle->backlog += 1;
+		return true;
+	}
+
+	handle->dropped += 1;
+	return false;
+}
+
+// rt-safe, hands a filtered event over to the worker for writing to file
+void
+_inspector_record(handle_t *handle, const LV2_Atom_Event *ev, uint32_t ev_size,
+	uint32_t nsamples)
+{
+	const record_t rec = {
+		.type = RECORD_TYPE_EVENT,
+		.size = ev_size,
+		.offset = handle->frame,
+		.counter = handle->counter,
+		.nsamples = nsamples
+	};
+
+	if(ring_write(&handle->record, &rec, sizeof(record_t), ev, ev_size))
+		handle->recorded = true;
+	else
+		atomic_fetch_add_explicit(&handle->record_lost, 1, memory_order_relaxed);
+}
+
+// rt-safe, forwards as many events handed back by the worker as fit
+uint32_t
+_inspector_trickle(handle_t *handle)
+{
+	craft_t *notify = &handle->notify;
+	const uint32_t max_size = _inspector_capacity(handle);
+	LV2_Atom_Long *offset = NULL;
+	capture_t prev = { .offset = 0 };
+	capture_t cap;
+	uint32_t nforwarded = 0;
+
+	const uint32_t lost = atomic_load_explicit(&handle->lost, memory_order_relaxed);
+	if(lost != handle->lost_seen)
+	{
+		handle->dropped += lost - handle->lost_seen;
+		handle->backlog -= lost - handle->lost_seen;
+		handle->lost_seen = lost;
+	}
+
+	while(ring_peek(&handle->trickle, 0, &cap, sizeof(capture_t)))
+	{
+		const bool same = offset
+			&& (cap.offset == prev.offset) && (cap.nsamples == prev.nsamples);
+		const uint32_t size = lv2_atom_pad_size(cap.size) + (same ? 0 : TUPLE_SIZE);
+		const uint32_t need = size + (offset ? TUPLE_TAIL_SIZE : 0); // open tuple still needs its tail
+
+		if(size > max_size) // notify port has shrunk since deferral
+		{
+			ring_advance(&handle->trickle, sizeof(capture_t) + cap.size);
+			handle->backlog -= 1;
+			handle->dropped += 1;
+			continue;
+		}
+
+		if(!_inspector_fits(handle, need, false))
+			break;
+
+		const uint8_t *ptr1;
+		const uint8_t *ptr2;
+		size_t size1;
+		size_t size2;
+
+		// header and body are written at once, so this only fails on a torn ring
+		if(!ring_regions(&handle->trickle, sizeof(capture_t), cap.size,
+			&ptr1, &size1, &ptr2, &size2))
+		{
+			break;
+		}
+
+		if(!same) // events of each original cycle get their own tuple
+		{
+			if(offset)
+				_inspector_tuple_tail(handle);
+
+			offset = _inspector_tuple_head(handle, cap.offset, cap.nsamples);
+			prev = cap;
+		}
+
+		if(notify->ref)
+			notify->ref = lv2_atom_forge_raw(&notify->forge, ptr1, size1);
+		if(notify->ref && size2)
+			notify->ref = lv2_atom_forge_raw(&notify->forge, ptr2, size2);
+		if(notify->ref)
+			lv2_atom_forge_pad(&notify->forge, cap.size);
+
+		ring_advance(&handle->trickle, sizeof(capture_t) + cap.size);
+		handle->backlog -= 1;
+		nforwarded += 1;
+	}
+
+	if(offset)
+		_inspector_tuple_tail(handle);
+
+	return nforwarded;
+}
+
+// rt-safe
+void
+_filter_changed(void *data, int64_t frames, props_impl_t *impl)
+{
+	handle_t *handle = data;
+
+	if(impl->def->offset == offsetof(state_t, predicate))
+	{
+		// malformed programs disable the predicate, so evaluation needs no checks
+		handle->npredicate = predicate_validate(&handle->state.predicate, impl->value.size);
+		return;
+	}
+
+	if(impl->def->offset == offsetof(state_t, filters))
+		handle->nfilters = _filters_count(&handle->state.filters, impl->value.size);
+
+	_urid_set_clear(&handle->filter_set);
+	_urid_set_add(&handle->filter_set, handle->state.filter);
+	for(uint32_t i = 0; i < handle->nfilters; i++)
+		_urid_set_add(&handle->filter_set, handle->state.filters.urids[i]);
+}
+
+// rt-safe
+void
+_pattern_changed(void *data, int64_t frames, props_impl_t *impl)
+{
+	handle_t *handle = data;
+	pattern_job_t job = {
+		.type = JOB_PATTERN
+	};
+
+	// string from patch:Set or state may lack its terminator
+	const size_t max_len = impl->value.size < PATTERN_SIZE
+		? impl->value.size
+		: PATTERN_SIZE - 1;
+	const size_t len = strnlen(handle->state.pattern, max_len);
+	memcpy(job.pattern, handle->state.pattern, len);
+	job.pattern[len] = '\0';
+
+	if(handle->sched) // compile on worker thread
+	{
+		handle->sched->schedule_work(handle->sched->handle,
+			offsetof(pattern_job_t, pattern) + len + 1, &job);
+	}
+	else
+	{
+		osc_pattern_compile(&handle->pattern, job.pattern);
+	}
+}
+
+// rt-safe
+void
+_record_changed(void *data, int64_t frames, props_impl_t *impl)
+{
+	handle_t *handle = data;
+	record_job_t job = {
+		.type = JOB_RECORD,
+		.record = handle->state.record
+	};
+
+	if(!handle->sched) // file i/o needs a worker
+		return;
+
+	const size_t max_len = impl->def->offset == offsetof(state_t, record_path)
+		&& (impl->value.size < PATH_SIZE)
+		? impl->value.size
+		: PATH_SIZE - 1;
+	const size_t len = strnlen(handle->state.record_path, max_len);
+	memcpy(job.path, handle->state.record_path, len);
+	job.path[len] = '\0';
+
+	// worker drains the ring before switching files, so just stop filling it
+	handle->recording = job.record && (len > 0);
+
+	handle->sched->schedule_work(handle->sched->handle,
+		offsetof(record_job_t, path) + len + 1, &job);
+}
+
+// non-rt
+void
+_inspector_trace_log(handle_t *handle, const trace_t *trace)
+{
+	const LV2_Atom_Forge *forge = &handle->through.forge;
+	const int64_t frames = trace->frames;
+	const void *body = trace->body;
+	const int len = trace->size < sizeof(trace->body) ? (int)trace->size : (int)sizeof(trace->body);
+	const char *ellipsis = trace->size > sizeof(trace->body) ? "..." : "";
+
+	if(lv2_atom_forge_is_object_type(forge, trace->type))
+	{
+		const LV2_Atom_Object_Body *obj = body;
+
+		lv2_log_trace(&handle->logger, "%4"PRIi64", object, %s\n", frames,
+			handle->unmap->unmap(handle->unmap->handle, obj->otype));
+		//FIXME introspect object?
+	}
+	else if(trace->type == forge->Bool)
+	{
+		lv2_log_trace(&handle->logger, "%4"PRIi64", bool  , %s\n", frames,
+			*(const int32_t *)body ? "true" : "false");
+	}
+	else if(trace->type == forge->Int)
+	{
+		lv2_log_trace(&handle->logger, "%4"PRIi64", int32 , %"PRIi32"\n", frames,
+			*(const int32_t *)body);
+	}
+	else if(trace->type == forge->Long)
+	{
+		lv2_log_trace(&handle->logger, "%4"PRIi64", int64 , %"PRIi64"\n", frames,
+			*(const int64_t *)body);
+	}
+	else if(trace->type == forge->Float)
+	{
+		lv2_log_trace(&handle->logger, "%4"PRIi64", flt32 , %f\n", frames,
+			*(const float *)body);
+	}
+	else if(trace->type == forge->Double)
+	{
+		lv2_log_trace(&handle->logger, "%4"PRIi64", flt64 , %lf\n", frames,
+			*(const double *)body);
+	}
+	else if(trace->type == forge->URID)
+	{
+		lv2_log_trace(&handle->logger, "%4"PRIi64", urid  , %s\n", frames,
+			handle->unmap->unmap(handle->unmap->handle, *(const uint32_t *)body));
+	}
+	else if(trace->type == forge->String)
+	{
+		lv2_log_trace(&handle->logger, "%4"PRIi64", string, %.*s%s\n", frames,
+			len, (const char *)body, ellipsis);
+	}
+	else if(trace->type == forge->URI)
+	{
+		lv2_log_trace(&handle->logger, "%4"PRIi64", uri   , %.*s%s\n", frames,
+			len, (const char *)body, ellipsis);
+	}
+	else if(trace->type == forge->Path)
+	{
+		lv2_log_trace(&handle->logger, "%4"PRIi64", path  , %.*s%s\n", frames,
+			len, (const char *)body, ellipsis);
+	}
+	//FIXME more types
+	else
+	{
+		lv2_log_trace(&handle->logger, "%4"PRIi64", %s\n", frames,
+			handle->unmap->unmap(handle->unmap->handle, trace->type));
+	}
+}
+
+static LV2_State_Status
+_state_save(LV2_Handle instance, LV2_State_Store_Function store,
+	LV2_State_Handle state, uint32_t flags,
+	const LV2_Feature *const *features)
+{
+	handle_t *handle = instance;
+
+	return props_save(&handle->props, store, state, flags, features);
+}
+
+static LV2_State_Status
+_state_restore(LV2_Handle instance, LV2_State_Retrieve_Function retrieve,
+	LV2_State_Handle state, uint32_t flags,
+	const LV2_Feature *const *features)
+{
+	handle_t *handle = instance;
+
+	return props_restore(&handle->props, retrieve, state, flags, features);
+}
+
+static const LV2_State_Interface state_iface = {
+	.save = _state_save,
+	.restore = _state_restore
+};
+
+static inline void
+_backlog_push(handle_t *handle, const capture_t *cap)
+{
+	const size_t size = sizeof(capture_t) + cap->size;
+
+	if( (handle->pending_size + size > BACKLOG_MAX) || (size > TRICKLE_SIZE) )
+	{
+		ring_advance(&handle->capture, size);
+		atomic_fetch_add_explicit(&handle->lost, 1, memory_order_relaxed);
+		return;
+	}
+
+	if(handle->pending_off + handle->pending_size + size > handle->pending_max)
+	{
+		// compact first, only grow when that does not suffice
+		if(handle->pending_off)
+		{
+			memmove(handle->pending, handle->pending + handle->pending_off, handle->pending_size);
+			handle->pending_off = 0;
+		}
+
+		if(handle->pending_size + size > handle->pending_max)
+		{
+			size_t max = handle->pending_max ? handle->pending_max : TRICKLE_SIZE;
+			while(max < handle->pending_size + size)
+				max <<= 1;
+
+			uint8_t *pending = realloc(handle->pending, max);
+			if(!pending)
+			{
+				ring_advance(&handle->capture, size);
+				atomic_fetch_add_explicit(&handle->lost, 1, memory_order_relaxed);
+				return;
+			}
+
+			handle->pending = pending;
+			handle->pending_max = max;
+		}
+	}
+
+	ring_read(&handle->capture, handle->pending + handle->pending_off + handle->pending_size, size);
+	handle->pending_size += size;
+}
+
+// non-rt
+static void
+_record_write(handle_t *handle, uint32_t type, const record_t *rec, const void *body)
+{
+	static const uint8_t zeros [8] = { 0 };
+	const record_t hdr = {
+		.type = type,
+		.size = rec ? rec->size : 0,
+		.offset = rec ? rec->offset : 0,
+		.counter = rec ? rec->counter : 0,
+		.nsamples = rec ? rec->nsamples : 0
+	};
+
+	fwrite(&hdr, sizeof(record_t), 1, handle->record_file);
+	fwrite(body, hdr.size, 1, handle->record_file);
+	fwrite(zeros, lv2_atom_pad_size(hdr.size) - hdr.size, 1, handle->record_file);
+}
+
+// non-rt, writes URID record when URID is used in this file for the first time
+static void
+_record_urid(handle_t *handle, LV2_URID urid)
+{
+	const size_t idx = urid >> 3;
+	const uint8_t bit = 1 << (urid & 0x7);
+
+	if(!urid)
+		return;
+
+	if(idx >= handle->record_seen_max)
+	{
+		const size_t max = (idx + 1) * 2;
+		uint8_t *seen = realloc(handle->record_seen, max);
+
+		if(!seen)
+			return;
+
+		memset(seen + handle->record_seen_max, 0x0, max - handle->record_seen_max);
+		handle->record_seen = seen;
+		handle->record_seen_max = max;
+	}
+
+	if(handle->record_seen[idx] & bit)
+		return;
+
+	const char *uri = handle->unmap->unmap(handle->unmap->handle, urid);
+	if(!uri)
+		return;
+
+	const size_t len = strlen(uri) + 1;
+	char buf [sizeof(LV2_URID) + len];
+	memcpy(buf, &urid, sizeof(LV2_URID));
+	memcpy(buf + sizeof(LV2_URID), uri, len);
+
+	const record_t rec = {
+		.size = sizeof(buf)
+	};
+	_record_write(handle, RECORD_TYPE_URID, &rec, buf);
+	handle->record_seen[idx] |= bit;
+}
+
+// non-rt, walks atom for all URIDs it references
+static void
+_record_urids(handle_t *handle, const LV2_Atom *atom)
+{
+	const LV2_Atom_Forge *forge = &handle->through.forge;
+
+	_record_urid(handle, atom->type);
+
+	if(lv2_atom_forge_is_object_type(forge, atom->type))
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)atom;
+
+		_record_urid(handle, obj->body.id);
+		_record_urid(handle, obj->body.otype);
+
+		LV2_ATOM_OBJECT_FOREACH(obj, prop)
+		{
+			_record_urid(handle, prop->key);
+			_record_urid(handle, prop->context);
+			_record_urids(handle, &prop->value);
+		}
+	}
+	else if(atom->type == forge->Tuple)
+	{
+		LV2_ATOM_TUPLE_FOREACH((const LV2_Atom_Tuple *)atom, item)
+			_record_urids(handle, item);
+	}
+	else if(atom->type == forge->Sequence)
+	{
+		const LV2_Atom_Sequence *seq = (const LV2_Atom_Sequence *)atom;
+
+		_record_urid(handle, seq->body.unit);
+
+		LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+			_record_urids(handle, &ev->body);
+	}
+	else if(atom->type == forge->Vector)
+	{
+		const LV2_Atom_Vector *vec = (const LV2_Atom_Vector *)atom;
+
+		_record_urid(handle, vec->body.child_type);
+
+		if(vec->body.child_type == forge->URID)
+		{
+			const LV2_URID *urids = LV2_ATOM_CONTENTS_CONST(LV2_Atom_Vector, vec);
+			const uint32_t n = (vec->atom.size - sizeof(LV2_Atom_Vector_Body)) / sizeof(LV2_URID);
+
+			for(uint32_t i = 0; i < n; i++)
+				_record_urid(handle, urids[i]);
+		}
+	}
+	else if(atom->type == forge->URID)
+	{
+		_record_urid(handle, ((const LV2_Atom_URID *)atom)->body);
+	}
+}
+
+// non-rt, moves records from ring to file, which buffers them to large blocks
+static void
+_record_drain(handle_t *handle)
+{
+	record_t rec;
+
+	while(ring_peek(&handle->record, 0, &rec, sizeof(record_t)))
+	{
+		if(rec.size > handle->record_scratch_max)
+		{
+			uint8_t *scratch = realloc(handle->record_scratch, rec.size);
+
+			if(!scratch)
+			{
+				ring_advance(&handle->record, sizeof(record_t) + rec.size);
+				atomic_fetch_add_explicit(&handle->record_lost, 1, memory_order_relaxed);
+				continue;
+			}
+
+			handle->record_scratch = scratch;
+			handle->record_scratch_max = rec.size;
+		}
+
+		ring_peek(&handle->record, sizeof(record_t), handle->record_scratch, rec.size);
+		ring_advance(&handle->record, sizeof(record_t) + rec.size);
+
+		if(handle->record_file)
+		{
+			const LV2_Atom_Event *ev = (const LV2_Atom_Event *)handle->record_scratch;
+
+			_record_urids(handle, &ev->body);
+			_record_write(handle, RECORD_TYPE_EVENT, &rec, ev);
+		}
+	}
+
+	const uint32_t record_lost = atomic_exchange_explicit(&handle->record_lost, 0,
+		memory_order_relaxed);
+	if(record_lost && handle->log)
+		lv2_log_warning(&handle->logger, "%"PRIu32" records dropped\n", record_lost);
+}
+
+// non-rt
+static void
+_record_close(handle_t *handle)
+{
+	_record_drain(handle);
+
+	if(handle->record_file)
+	{
+		fclose(handle->record_file);
+		handle->record_file = NULL;
+	}
+
+	if(handle->record_stdio)
+	{
+		free(handle->record_stdio);
+		handle->record_stdio = NULL;
+	}
+}
+
+// non-rt, existing files must have been recorded in the same format and rate
+static bool
+_record_check(handle_t *handle, const char *path)
+{
+	FILE *file = fopen(path, "rb");
+	if(!file) // to be created
+		return true;
+
+	record_header_t hdr;
+	bool valid = true;
+
+	if( (fseek(file, 0, SEEK_END) == 0) && (ftell(file) == 0) )
+	{
+		// empty, header is written anew
+	}
+	else if( (fseek(file, 0, SEEK_SET) != 0)
+		|| (fread(&hdr, sizeof(record_header_t), 1, file) != 1)
+		|| memcmp(hdr.magic, RECORD_MAGIC, sizeof(hdr.magic))
+		|| (hdr.version != RECORD_VERSION) )
+	{
+		if(handle->log)
+			lv2_log_error(&handle->logger, "not a capture file: %s\n", path);
+		valid = false;
+	}
+	else if(hdr.rate != handle->rate)
+	{
+		if(handle->log)
+			lv2_log_error(&handle->logger, "capture file recorded at %lf Hz: %s\n",
+				hdr.rate, path);
+		valid = false;
+	}
+
+	fclose(file);
+
+	return valid;
+}
+
+// non-rt
+static void
+_record_open(handle_t *handle, const char *path)
+{
+	if(!_record_check(handle, path)) // refuse to append to foreign files
+		return;
+
+	handle->record_file = fopen(path, "ab");
+	if(!handle->record_file)
+	{
+		if(handle->log)
+			lv2_log_error(&handle->logger, "failed to open capture file: %s\n", path);
+		return;
+	}
+
+	handle->record_stdio = malloc(RECORD_BLOCK);
+	if(handle->record_stdio)
+		setvbuf(handle->record_file, handle->record_stdio, _IOFBF, RECORD_BLOCK);
+
+	// URIDs of this session have to be written out anew
+	if(handle->record_seen)
+		memset(handle->record_seen, 0x0, handle->record_seen_max);
+
+	if(ftell(handle->record_file) == 0)
+	{
+		record_header_t hdr = {
+			.magic = RECORD_MAGIC,
+			.version = RECORD_VERSION,
+			.rate = handle->rate
+		};
+
+		fwrite(&hdr, sizeof(record_header_t), 1, handle->record_file);
+	}
+}
+
+// non-rt
+static LV2_Worker_Status
+_work(LV2_Handle instance, LV2_Worker_Respond_Function respond,
+	LV2_Worker_Respond_Handle worker, uint32_t size, const void *body)
+{
+	handle_t *handle = instance;
+	const uint32_t *type = body;
+	capture_t cap;
+
+	if( (size >= sizeof(uint32_t)) && (*type == JOB_PATTERN) )
+	{
+		const pattern_job_t *job = body;
+		osc_pattern_t pattern;
+
+		// invalid patterns compile to an empty one, e.g. let everything through
+		if( (osc_pattern_compile(&pattern, job->pattern) != 0) && handle->log)
+			lv2_log_error(&handle->logger, "invalid OSC pattern: %s\n", job->pattern);
+
+		return respond(worker, sizeof(osc_pattern_t), &pattern);
+	}
+	else if( (size >= sizeof(uint32_t)) && (*type == JOB_RECORD) )
+	{
+		const record_job_t *job = body;
+
+		_record_close(handle);
+		if(job->record && job->path[0])
+			_record_open(handle, job->path);
+
+		return LV2_WORKER_SUCCESS;
+	}
+
+	// drain events deferred by run() into backlog
+	while(ring_peek(&handle->capture, 0, &cap, sizeof(capture_t)))
+		_backlog_push(handle, &cap);
+
+	// hand back as much of the backlog as run() can currently take
+	while(handle->pending_size)
+	{
+		const uint8_t *src = handle->pending + handle->pending_off;
+
+		memcpy(&cap, src, sizeof(capture_t));
+		const size_t sz = sizeof(capture_t) + cap.size;
+
+		if(!ring_write(&handle->trickle, src, sz, NULL, 0))
+			break;
+
+		handle->pending_off += sz;
+		handle->pending_size -= sz;
+	}
+
+	if(!handle->pending_size)
+		handle->pending_off = 0;
+
+	// write records captured by run()
+	_record_drain(handle);
+
+	// format and emit trace recorded by run()
+	trace_t trace;
+	while(ring_read(&handle->trace, &trace, sizeof(trace_t)))
+		_inspector_trace_log(handle, &trace);
+
+	const uint32_t trace_lost = atomic_exchange_explicit(&handle->trace_lost, 0,
+		memory_order_relaxed);
+	if(trace_lost)
+		lv2_log_trace(&handle->logger, "%"PRIu32" trace lines dropped\n", trace_lost);
+
+	return LV2_WORKER_SUCCESS;
+}
+
+// rt-safe
+static LV2_Worker_Status
+_work_response(LV2_Handle instance, uint32_t size, const void *body)
+{
+	handle_t *handle = instance;
+
+	// swap in pattern compiled by worker
+	if(size == sizeof(osc_pattern_t))
+		memcpy(&handle->pattern, body, size);
+
+	return LV2_WORKER_SUCCESS;
+}
+
+static const LV2_Worker_Interface work_iface = {
+	.work = _work,
+	.work_response = _work_response,
+	.end_run = NULL
+};
+
+const void*
+_inspector_extension_data(const char* uri)
+{
+	if(!strcmp(uri, LV2_STATE__interface))
+		return &state_iface;
+	else if(!strcmp(uri, LV2_WORKER__interface))
+		return &work_iface;
+
+	return NULL;
+}
+
 #ifdef _WIN32
 __declspec(dllexport)
 #else
@@ -33,6 +1308,10 @@ lv2_descriptor(uint32_t index)
 			return &midi_inspector;
 		case 2:
 			return &osc_inspector;
+		case 3:
+			return &replay;
+		case 4:
+			return &generator;
 		default:
 			return NULL;
 	}
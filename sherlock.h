@@ -20,6 +20,8 @@
 
 #include <stdint.h>
 #include <inttypes.h>
+#include <time.h>
+#include <math.h>
 
 #include "lv2/lv2plug.in/ns/ext/atom/atom.h"
 #include "lv2/lv2plug.in/ns/ext/atom/forge.h"
@@ -30,12 +32,19 @@
 #include "lv2/lv2plug.in/ns/ext/patch/patch.h"
 #include "lv2/lv2plug.in/ns/ext/log/log.h"
 #include "lv2/lv2plug.in/ns/ext/log/logger.h"
+#include "lv2/lv2plug.in/ns/ext/worker/worker.h"
+#include "lv2/lv2plug.in/ns/ext/options/options.h"
+#include "lv2/lv2plug.in/ns/ext/buf-size/buf-size.h"
 #include "lv2/lv2plug.in/ns/extensions/units/units.h"
 #include "lv2/lv2plug.in/ns/extensions/ui/ui.h"
 #include "lv2/lv2plug.in/ns/lv2core/lv2.h"
 
 #include <stdio.h>
 #include <props.h>
+#include <osc.lv2/osc.h>
+#include <ring.h>
+#include <predicate.h>
+#include <osc_pattern.h>
 	
 #define SHERLOCK_URI										"http://open-music-kontrollers.ch/lv2/sherlock"
 
@@ -48,19 +57,61 @@
 #define SHERLOCK_OSC_INSPECTOR_URI			SHERLOCK_URI"#osc_inspector"
 #define SHERLOCK_OSC_INSPECTOR_NK_URI		SHERLOCK_URI"#osc_inspector_4_nk"
 
+#define SHERLOCK_REPLAY_URI							SHERLOCK_URI"#replay"
+#define SHERLOCK_GENERATOR_URI					SHERLOCK_URI"#generator"
+
 extern const LV2_Descriptor atom_inspector;
 extern const LV2_Descriptor midi_inspector;
 extern const LV2_Descriptor osc_inspector;
+extern const LV2_Descriptor replay;
+extern const LV2_Descriptor generator;
 
 typedef struct _position_t position_t;
 typedef struct _state_t state_t;
 typedef struct _craft_t craft_t;
+typedef struct _capture_t capture_t;
+typedef struct _trace_t trace_t;
+typedef struct _filters_t filters_t;
+typedef struct _urid_set_t urid_set_t;
+typedef enum _job_type_t job_type_t;
+typedef struct _pattern_job_t pattern_job_t;
+typedef struct _record_job_t record_job_t;
+typedef struct _record_header_t record_header_t;
+typedef struct _record_t record_t;
+typedef struct _budget_t budget_t;
+typedef struct _stage_t stage_t;
+typedef struct _packed_midi_t packed_midi_t;
+typedef struct _pack_t pack_t;
+typedef struct _probe_t probe_t;
+typedef struct _transport_t transport_t;
+typedef struct _transport_urid_t transport_urid_t;
+typedef struct _fragment_urid_t fragment_urid_t;
+typedef struct _stats_slot_t stats_slot_t;
+typedef struct _stats_t stats_t;
+typedef struct _stats_urid_t stats_urid_t;
+typedef struct _handle_t handle_t;
 
 struct _position_t {
 	uint64_t offset;
 	uint32_t nsamples;
 };
 
+#define MAX_FILTERS 32
+#define PATTERN_SIZE 256
+#define PATH_SIZE 1024
+#define URID_SET_BITS 6
+#define URID_SET_SIZE (1 << URID_SET_BITS) // keeps load factor below 0.6
+
+struct _filters_t {
+	LV2_Atom_Vector_Body body;
+	LV2_URID urids [MAX_FILTERS];
+};
+
+// open addressing hash set, 0 marks an empty slot
+struct _urid_set_t {
+	LV2_URID slots [URID_SET_SIZE];
+};
+
 struct _state_t {
 	int32_t overwrite;
 	int32_t block;
@@ -69,6 +120,21 @@ struct _state_t {
 	int32_t trace;
 	uint32_t filter;
 	int32_t negate;
+	int32_t lossless;
+	filters_t filters;
+	predicate_t predicate;
+	int32_t channels; // bit per MIDI channel
+	int32_t statuses; // bit per MIDI status nibble 0x8-0xf
+	int32_t range_min; // note or controller number
+	int32_t range_max;
+	char pattern [PATTERN_SIZE]; // OSC address pattern
+	int32_t record;
+	char record_path [PATH_SIZE];
+	int32_t stats;
+	int32_t stats_period; // in cycles
+	int32_t budget_events; // per second, 0 for unlimited
+	int32_t budget_bytes; // per second, 0 for unlimited
+	int32_t decimate; // forward every Nth event only
 };
 
 struct _craft_t {
@@ -81,7 +147,281 @@ struct _craft_t {
 	};
 };
 
-#define MAX_NPROPS 7
+enum _job_type_t {
+	JOB_DRAIN = 0,
+	JOB_PATTERN,
+	JOB_RECORD
+};
+
+struct _pattern_job_t {
+	uint32_t type; // JOB_PATTERN
+	char pattern [PATTERN_SIZE];
+};
+
+struct _record_job_t {
+	uint32_t type; // JOB_RECORD
+	int32_t record;
+	char path [PATH_SIZE];
+};
+
+/*
+ * Capture files start with a record_header_t followed by records, each
+ * padded to 8 bytes. Event records carry a LV2_Atom_Event with URIDs of the
+ * recording host, URID records map those to URIs and always precede the
+ * first event using them. A file may be appended to by several sessions,
+ * later URID records then override earlier ones.
+ */
+#define RECORD_MAGIC "SHERLOCK"
+#define RECORD_VERSION 1
+
+enum {
+	RECORD_TYPE_EVENT = 0,
+	RECORD_TYPE_URID
+};
+
+struct _record_header_t {
+	char magic [8];
+	uint32_t version;
+	uint32_t reserved;
+	double rate;
+};
+
+struct _record_t {
+	uint32_t type;
+	uint32_t size; // of the unpadded payload following the header
+	int64_t offset; // frame time of cycle
+	uint32_t counter; // cycle
+	uint32_t nsamples;
+};
+
+// header of an event deferred to the worker in lossless mode
+struct _capture_t {
+	int64_t offset;
+	uint32_t nsamples;
+	uint32_t size; // of the LV2_Atom_Event following the header
+};
+
+// binary trace record, formatted by worker
+struct _trace_t {
+	int64_t frames;
+	LV2_URID type;
+	uint32_t size;
+	uint8_t body [16]; // truncated
+};
+
+#define STATS_BITS 5
+#define STATS_SIZE (1 << STATS_BITS)
+#define STATS_LOAD (STATS_SIZE * 3 / 4) // distinct types tracked, rest is lumped
+#define STATS_ATOM_MAX 0x400 // upper bound of a summary atom event
+
+// one row of per-type counters, open addressing on type or object type
+struct _stats_slot_t {
+	LV2_URID type; // 0 marks an empty slot
+	uint32_t count;
+	uint64_t bytes;
+};
+
+// counters of a stats period, lives in plugin only
+struct _stats_t {
+	int64_t offset; // frame time of first cycle
+	uint64_t frames;
+	uint32_t cycles;
+	uint32_t events;
+	uint32_t cycle_events; // in current cycle
+	uint32_t peak; // events in busiest cycle
+	uint64_t bytes;
+	int64_t min_frames; // earliest event offset within a cycle
+	int64_t max_frames; // latest event offset within a cycle
+	uint32_t largest;
+	LV2_URID largest_type;
+	uint32_t ntypes;
+	uint32_t other; // events of types beyond STATS_LOAD
+	uint64_t other_bytes;
+	stats_slot_t slots [STATS_SIZE];
+};
+
+// keys of summary object, shared by plugin and UI
+struct _stats_urid_t {
+	LV2_URID Stats;
+	LV2_URID offset;
+	LV2_URID period;
+	LV2_URID cycles;
+	LV2_URID events;
+	LV2_URID peak;
+	LV2_URID bytes;
+	LV2_URID min_frames;
+	LV2_URID max_frames;
+	LV2_URID largest;
+	LV2_URID largest_type;
+	LV2_URID types;
+	LV2_URID counts;
+	LV2_URID sizes;
+};
+
+// token buckets of notify budget, may go into debt by one event
+struct _budget_t {
+	double events;
+	double bytes;
+	uint32_t count; // events seen for decimation
+};
+
+#define BUDGET_BURST 0.1 // seconds of budget a bucket holds at most
+
+#define STAGE_SIZE 0x400000 // largest event sent in fragments, unless the host tells sequence size
+#define FRAGMENT_OVERHEAD 0x100 // upper bound of fragment object without data
+
+// event too big for the notify port, sent to the UI in fragments over several cycles
+struct _stage_t {
+	int64_t offset; // frame time of original cycle
+	uint32_t nsamples;
+	uint32_t id; // of transfer
+	uint32_t index; // of next fragment
+	uint32_t size; // of staged LV2_Atom_Event, 0 when idle
+	uint32_t sent;
+};
+
+/*
+ * Packed notify tuples carry a vector of packed_midi_t instead of a sequence
+ * and a chunk with spilled messages after the probe vector. Messages of up
+ * to 3 bytes are stored inline, longer ones have size 0, their 24 bit length
+ * in data and their bytes appended to the chunk, in order.
+ *
+ * Runs of identical inline messages (e.g. clock, active sensing) are sent as
+ * the first message followed by a repeat record, which has size PACK_REPEAT,
+ * the frame of the last message and the 24 bit number of repeats in data.
+ */
+#define PACK_MAX 0x2000 // records per cycle
+#define PACK_SPILL_SIZE 0x10000 // spilled bytes per cycle
+#define PACK_REPEAT 0x80
+#define PACK_REPEAT_MAX 0xffffff
+
+struct _packed_midi_t {
+	uint32_t frames;
+	uint8_t data [3];
+	uint8_t size;
+};
+
+struct _pack_t {
+	uint32_t n;
+	uint32_t spill;
+	packed_midi_t records [PACK_MAX];
+	uint8_t spill_buf [PACK_SPILL_SIZE];
+};
+
+/*
+ * Self instrumentation, the last item of notify tuples is a vector of longs
+ * with min/mean/max cost of run() and callback jitter in ns, over the cycles
+ * since the previous tuple. Jitter is the time between successive calls minus
+ * the duration of the earlier cycle at the nominal sample rate. Without event
+ * traffic, a tuple without events carries the probe every PROBE_PERIOD, but
+ * only when it differs from the one sent last at the us resolution of the UI.
+ */
+enum {
+	PROBE_RUN_MIN = 0,
+	PROBE_RUN_MEAN,
+	PROBE_RUN_MAX,
+	PROBE_JITTER_MIN,
+	PROBE_JITTER_MEAN,
+	PROBE_JITTER_MAX,
+
+	PROBE_MAX
+};
+
+#define PROBE_SIZE (sizeof(LV2_Atom_Vector) + PROBE_MAX*sizeof(int64_t))
+#define PROBE_PERIOD 0.25 // seconds
+
+struct _probe_t {
+	int64_t start; // of current call
+	int64_t period; // of previous cycle at nominal rate
+	uint32_t elapsed; // samples since probe was last sent
+	int64_t sent [PROBE_MAX]; // values last sent, in us
+	uint32_t runs;
+	int64_t run_sum;
+	int64_t run_min;
+	int64_t run_max;
+	uint32_t jitters;
+	int64_t jitter_sum;
+	int64_t jitter_min;
+	int64_t jitter_max;
+};
+
+/*
+ * Transport analyzer, the position reported by time:Position is compared to
+ * the one expected from the previous position and speed. Discontinuities are
+ * sent as Discontinuity objects with the flags below, expected and reported
+ * frame, and the musical position after the discontinuity.
+ */
+#define TRANSPORT_TOLERANCE 1 // frames, for rounding with fractional speeds
+
+enum {
+	TRANSPORT_JUMP = (1 << 0), // ahead of expected, e.g. seek or xrun
+	TRANSPORT_REWIND = (1 << 1), // behind expected, e.g. loop or seek
+	TRANSPORT_SPEED = (1 << 2) // started, stopped or changed speed
+};
+
+struct _transport_t {
+	bool valid; // a frame position has been seen
+	double frame; // expected at start of cycle
+	double speed;
+	int64_t bar;
+	double bar_beat;
+	double bpm;
+};
+
+// keys of discontinuity object, shared by plugin and UI
+struct _transport_urid_t {
+	LV2_URID Discontinuity;
+	LV2_URID flags;
+	LV2_URID expected;
+	LV2_URID frame;
+	LV2_URID speed;
+	LV2_URID bar;
+	LV2_URID bar_beat;
+	LV2_URID bpm;
+};
+
+// keys of fragment object, shared by plugin and UI
+struct _fragment_urid_t {
+	LV2_URID Fragment;
+	LV2_URID id;
+	LV2_URID index;
+	LV2_URID offset;
+	LV2_URID nsamples;
+	LV2_URID total;
+	LV2_URID data;
+};
+
+#define MAX_NPROPS 22
+#define REPLY_SIZE 0x2000
+#define CAPTURE_SIZE 0x40000 // rt -> worker
+#define TRICKLE_SIZE 0x40000 // worker -> rt
+#define BACKLOG_MAX 0x4000000 // worker side
+#define TRACE_SIZE 0x10000 // rt -> worker
+#define STRIP_SIZE 0x10000 // filtered copies of events
+#define RECORD_SIZE 0x100000 // rt -> worker
+#define RECORD_BLOCK 0x100000 // file buffer
+
+// frame time and tuple header, offset, padded nsamples, sequence header, dropped and skipped counters
+#define TUPLE_SIZE (sizeof(LV2_Atom_Event) + sizeof(LV2_Atom_Long) + sizeof(LV2_Atom_Long) \
+	+ sizeof(LV2_Atom_Sequence) + sizeof(LV2_Atom_Long) + sizeof(LV2_Atom_Long) + PROBE_SIZE)
+
+// dropped and skipped counters and probe still to be written while a tuple is open
+#define TUPLE_TAIL_SIZE (sizeof(LV2_Atom_Long) + sizeof(LV2_Atom_Long) + PROBE_SIZE)
+
+// notify space data events leave for patch replies and time:Position
+#define QOS_RESERVE 0x400
+
+// rt-safe, implemented separately by plugin and UI
+void
+_filter_changed(void *data, int64_t frames, props_impl_t *impl);
+
+// rt-safe, implemented separately by plugin and UI
+void
+_pattern_changed(void *data, int64_t frames, props_impl_t *impl);
+
+// rt-safe, implemented separately by plugin and UI
+void
+_record_changed(void *data, int64_t frames, props_impl_t *impl);
 
 static const props_def_t defs [MAX_NPROPS] = {
 	{
@@ -113,14 +453,955 @@ static const props_def_t defs [MAX_NPROPS] = {
 		.property = SHERLOCK_URI"#filter",
 		.offset = offsetof(state_t, filter),
 		.type = LV2_ATOM__URID,
+		.event_cb = _filter_changed
 	},
 	{
 		.property = SHERLOCK_URI"#negate",
 		.offset = offsetof(state_t, negate),
 		.type = LV2_ATOM__Bool,
+	},
+	{
+		.property = SHERLOCK_URI"#lossless",
+		.offset = offsetof(state_t, lossless),
+		.type = LV2_ATOM__Bool,
+	},
+	{
+		.property = SHERLOCK_URI"#filters",
+		.offset = offsetof(state_t, filters),
+		.type = LV2_ATOM__Vector,
+		.max_size = sizeof(filters_t),
+		.event_cb = _filter_changed
+	},
+	{
+		.property = SHERLOCK_URI"#predicate",
+		.offset = offsetof(state_t, predicate),
+		.type = LV2_ATOM__Chunk,
+		.max_size = sizeof(predicate_t),
+		.event_cb = _filter_changed
+	},
+	{
+		.property = SHERLOCK_URI"#channels",
+		.offset = offsetof(state_t, channels),
+		.type = LV2_ATOM__Int,
+	},
+	{
+		.property = SHERLOCK_URI"#statuses",
+		.offset = offsetof(state_t, statuses),
+		.type = LV2_ATOM__Int,
+	},
+	{
+		.property = SHERLOCK_URI"#rangeMin",
+		.offset = offsetof(state_t, range_min),
+		.type = LV2_ATOM__Int,
+	},
+	{
+		.property = SHERLOCK_URI"#rangeMax",
+		.offset = offsetof(state_t, range_max),
+		.type = LV2_ATOM__Int,
+	},
+	{
+		.property = SHERLOCK_URI"#pattern",
+		.offset = offsetof(state_t, pattern),
+		.type = LV2_ATOM__String,
+		.max_size = PATTERN_SIZE,
+		.event_cb = _pattern_changed
+	},
+	{
+		.property = SHERLOCK_URI"#record",
+		.offset = offsetof(state_t, record),
+		.type = LV2_ATOM__Bool,
+		.event_cb = _record_changed
+	},
+	{
+		.property = SHERLOCK_URI"#recordPath",
+		.offset = offsetof(state_t, record_path),
+		.type = LV2_ATOM__Path,
+		.max_size = PATH_SIZE,
+		.event_cb = _record_changed
+	},
+	{
+		.property = SHERLOCK_URI"#stats",
+		.offset = offsetof(state_t, stats),
+		.type = LV2_ATOM__Bool,
+	},
+	{
+		.property = SHERLOCK_URI"#statsPeriod",
+		.offset = offsetof(state_t, stats_period),
+		.type = LV2_ATOM__Int,
+	},
+	{
+		.property = SHERLOCK_URI"#budgetEvents",
+		.offset = offsetof(state_t, budget_events),
+		.type = LV2_ATOM__Int,
+	},
+	{
+		.property = SHERLOCK_URI"#budgetBytes",
+		.offset = offsetof(state_t, budget_bytes),
+		.type = LV2_ATOM__Int,
+	},
+	{
+		.property = SHERLOCK_URI"#decimate",
+		.offset = offsetof(state_t, decimate),
+		.type = LV2_ATOM__Int,
 	}
 };
 
+static inline void
+_stats_urid_init(stats_urid_t *urid, LV2_URID_Map *map)
+{
+	urid->Stats = map->map(map->handle, SHERLOCK_URI"#Stats");
+	urid->offset = map->map(map->handle, SHERLOCK_URI"#statsOffset");
+	urid->period = map->map(map->handle, SHERLOCK_URI"#statsSeconds");
+	urid->cycles = map->map(map->handle, SHERLOCK_URI"#statsCycles");
+	urid->events = map->map(map->handle, SHERLOCK_URI"#statsEvents");
+	urid->peak = map->map(map->handle, SHERLOCK_URI"#statsPeak");
+	urid->bytes = map->map(map->handle, SHERLOCK_URI"#statsBytes");
+	urid->min_frames = map->map(map->handle, SHERLOCK_URI"#statsMinFrames");
+	urid->max_frames = map->map(map->handle, SHERLOCK_URI"#statsMaxFrames");
+	urid->largest = map->map(map->handle, SHERLOCK_URI"#statsLargest");
+	urid->largest_type = map->map(map->handle, SHERLOCK_URI"#statsLargestType");
+	urid->types = map->map(map->handle, SHERLOCK_URI"#statsTypes");
+	urid->counts = map->map(map->handle, SHERLOCK_URI"#statsCounts");
+	urid->sizes = map->map(map->handle, SHERLOCK_URI"#statsSizes");
+}
+
+static inline void
+_fragment_urid_init(fragment_urid_t *urid, LV2_URID_Map *map)
+{
+	urid->Fragment = map->map(map->handle, SHERLOCK_URI"#Fragment");
+	urid->id = map->map(map->handle, SHERLOCK_URI"#fragmentId");
+	urid->index = map->map(map->handle, SHERLOCK_URI"#fragmentIndex");
+	urid->offset = map->map(map->handle, SHERLOCK_URI"#fragmentOffset");
+	urid->nsamples = map->map(map->handle, SHERLOCK_URI"#fragmentNsamples");
+	urid->total = map->map(map->handle, SHERLOCK_URI"#fragmentTotal");
+	urid->data = map->map(map->handle, SHERLOCK_URI"#fragmentData");
+}
+
+static inline void
+_transport_urid_init(transport_urid_t *urid, LV2_URID_Map *map)
+{
+	urid->Discontinuity = map->map(map->handle, SHERLOCK_URI"#Discontinuity");
+	urid->flags = map->map(map->handle, SHERLOCK_URI"#discontinuityFlags");
+	urid->expected = map->map(map->handle, SHERLOCK_URI"#discontinuityExpected");
+	urid->frame = map->map(map->handle, LV2_TIME__frame);
+	urid->speed = map->map(map->handle, LV2_TIME__speed);
+	urid->bar = map->map(map->handle, LV2_TIME__bar);
+	urid->bar_beat = map->map(map->handle, LV2_TIME__barBeat);
+	urid->bpm = map->map(map->handle, LV2_TIME__beatsPerMinute);
+}
+
+static inline uint32_t
+_urid_set_hash(LV2_URID urid)
+{
+	return (urid * 2654435761U) >> (32 - URID_SET_BITS); // Knuth multiplicative
+}
+
+// rt-safe
+static inline void
+_urid_set_clear(urid_set_t *set)
+{
+	memset(set->slots, 0x0, sizeof(set->slots));
+}
+
+// rt-safe
+static inline void
+_urid_set_add(urid_set_t *set, LV2_URID urid)
+{
+	if(!urid)
+		return;
+
+	for(uint32_t i = _urid_set_hash(urid); ; i = (i + 1) & (URID_SET_SIZE - 1))
+	{
+		if(set->slots[i] == urid)
+			return; // already member
+		if(!set->slots[i])
+		{
+			set->slots[i] = urid;
+			return;
+		}
+	}
+}
+
+// rt-safe, constant time as the set never gets more than about half full
+static inline bool
+_urid_set_has(const urid_set_t *set, LV2_URID urid)
+{
+	for(uint32_t i = _urid_set_hash(urid); ; i = (i + 1) & (URID_SET_SIZE - 1))
+	{
+		if(!set->slots[i])
+			return false;
+		if(set->slots[i] == urid)
+			return true;
+	}
+}
+
+static inline uint32_t
+_filters_count(const filters_t *filters, uint32_t size)
+{
+	if( (size <= sizeof(LV2_Atom_Vector_Body))
+		|| (filters->body.child_size != sizeof(LV2_URID)) )
+	{
+		return 0;
+	}
+
+	return (size - sizeof(LV2_Atom_Vector_Body)) / sizeof(LV2_URID);
+}
+
+struct _handle_t {
+	LV2_URID_Map *map;
+	LV2_URID_Unmap *unmap;
+	LV2_Log_Log *log;
+	LV2_Log_Logger logger;
+	LV2_Worker_Schedule *sched;
+
+	const LV2_Atom_Sequence *control;
+	craft_t through;
+	craft_t notify;
+	craft_t reply;
+	craft_t strip;
+
+	LV2_URID time_position;
+	LV2_URID time_frame;
+	LV2_URID midi_event;
+	LV2_URID packed_midi;
+	LV2_OSC_URID osc_urid;
+	stats_urid_t stats_urid;
+	fragment_urid_t fragment_urid;
+	transport_urid_t transport_urid;
+
+	double rate;
+	int64_t frame;
+	uint32_t counter; // of cycles
+	int64_t dropped;
+	int64_t skipped; // events held back by notify budget
+	int64_t dropped_sent; // counters as last sent to the UI
+	int64_t skipped_sent;
+	uint32_t backlog; // events deferred, but not yet forwarded
+	uint32_t lost_seen;
+	atomic_uint lost; // events discarded by worker
+	atomic_uint trace_lost; // trace records not fitting into ring
+	bool traced;
+	bool recording;
+	bool recorded;
+	atomic_uint record_lost; // records not fitting into ring
+
+	PROPS_T(props, MAX_NPROPS);
+	state_t state;
+	state_t stash;
+	uint32_t nfilters;
+	urid_set_t filter_set;
+	uint32_t npredicate;
+	osc_pattern_t pattern; // compiled by worker
+	stats_t stats;
+	budget_t budget;
+	stage_t stage;
+	pack_t pack;
+	probe_t probe;
+	transport_t transport;
+
+	ring_t capture;
+	ring_t trickle;
+	ring_t trace;
+	ring_t record;
+
+	// only ever touched by worker
+	uint8_t *pending;
+	size_t pending_off;
+	size_t pending_size;
+	size_t pending_max;
+	FILE *record_file;
+	char *record_stdio;
+	uint8_t *record_scratch;
+	size_t record_scratch_max;
+	uint8_t *record_seen; // bit per URID already written to file
+	size_t record_seen_max;
+
+	uint8_t reply_buf [REPLY_SIZE];
+	uint8_t strip_buf [STRIP_SIZE];
+	uint8_t *ring_buf; // capture, trickle, trace and record, only with a worker
+	uint8_t *stage_buf;
+	uint32_t stage_max;
+};
+
+// returns the event to forward to the UI, possibly a filtered copy, or NULL
+typedef const LV2_Atom_Event *(*inspector_filter_t)(handle_t *handle, const LV2_Atom_Event *ev);
+
+LV2_Handle
+_inspector_instantiate(const LV2_Descriptor* descriptor, double rate,
+	const char *bundle_path, const LV2_Feature *const *features);
+
+void
+_inspector_connect_port(LV2_Handle instance, uint32_t port, void *data);
+
+void
+_inspector_cleanup(LV2_Handle instance);
+
+const void*
+_inspector_extension_data(const char* uri);
+
+bool
+_inspector_defer(handle_t *handle, const LV2_Atom_Event *ev, uint32_t ev_size,
+	uint32_t nsamples);
+
+uint32_t
+_inspector_trickle(handle_t *handle);
+
+void
+_inspector_trace_log(handle_t *handle, const trace_t *trace);
+
+void
+_inspector_record(handle_t *handle, const LV2_Atom_Event *ev, uint32_t ev_size,
+	uint32_t nsamples);
+
+void
+_inspector_stats(handle_t *handle, uint32_t nsamples);
+
+void
+_inspector_stats_reset(handle_t *handle);
+
+bool
+_inspector_budget_refill(handle_t *handle, uint32_t nsamples);
+
+bool
+_inspector_stage(handle_t *handle, const LV2_Atom_Event *ev, uint32_t ev_size,
+	uint32_t nsamples);
+
+void
+_inspector_fragment(handle_t *handle);
+
+void
+_inspector_pack_flush(handle_t *handle, uint32_t nsamples);
+
+void
+_inspector_transport(handle_t *handle, const LV2_Atom_Object *obj, int64_t frames);
+
+// rt-safe when the host provides a worker, which then formats and logs
+static inline void
+_inspector_trace(handle_t *handle, const LV2_Atom_Event *ev)
+{
+	trace_t trace = {
+		.frames = ev->time.frames,
+		.type = ev->body.type,
+		.size = ev->body.size
+	};
+
+	memcpy(trace.body, LV2_ATOM_BODY_CONST(&ev->body),
+		ev->body.size < sizeof(trace.body) ? ev->body.size : sizeof(trace.body));
+
+	if(!handle->sched) // log right away as a fallback
+	{
+		_inspector_trace_log(handle, &trace);
+	}
+	else if(ring_write(&handle->trace, &trace, sizeof(trace_t), NULL, 0))
+	{
+		handle->traced = true;
+	}
+	else
+	{
+		atomic_fetch_add_explicit(&handle->trace_lost, 1, memory_order_relaxed);
+	}
+}
+
+// rt-safe, counts an event into the fixed-size table of the current period
+static inline void
+_inspector_stats_add(handle_t *handle, const LV2_Atom_Event *ev)
+{
+	stats_t *stats = &handle->stats;
+	const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+	const uint32_t size = ev->body.size;
+	const LV2_URID type = lv2_atom_forge_is_object_type(&handle->notify.forge, obj->atom.type)
+		&& obj->body.otype
+			? obj->body.otype
+			: obj->atom.type;
+
+	stats->cycle_events += 1;
+	stats->bytes += size;
+	if(ev->time.frames < stats->min_frames)
+		stats->min_frames = ev->time.frames;
+	if(ev->time.frames > stats->max_frames)
+		stats->max_frames = ev->time.frames;
+	if(size > stats->largest)
+	{
+		stats->largest = size;
+		stats->largest_type = type;
+	}
+
+	for(uint32_t i = (type * 2654435761U) >> (32 - STATS_BITS); ; i = (i + 1) & (STATS_SIZE - 1))
+	{
+		stats_slot_t *slot = &stats->slots[i];
+
+		if(slot->type == type)
+		{
+			slot->count += 1;
+			slot->bytes += size;
+			return;
+		}
+
+		if(!slot->type)
+		{
+			if(stats->ntypes < STATS_LOAD)
+			{
+				slot->type = type;
+				slot->count = 1;
+				slot->bytes = size;
+				stats->ntypes += 1;
+			}
+			else
+			{
+				stats->other += 1;
+				stats->other_bytes += size;
+			}
+			return;
+		}
+	}
+}
+
+// rt-safe, whether an event is within the notify budget
+static inline bool
+_inspector_budget(handle_t *handle)
+{
+	budget_t *budget = &handle->budget;
+	const state_t *state = &handle->state;
+
+	if( (state->decimate > 1) && (budget->count++ % state->decimate) )
+		return false;
+	if( (state->budget_events > 0) && (budget->events <= 0.0) )
+		return false;
+	if( (state->budget_bytes > 0) && (budget->bytes <= 0.0) )
+		return false;
+
+	return true;
+}
+
+// rt-safe, charges an event to the notify budget once it is on its way to the UI
+static inline void
+_inspector_budget_take(handle_t *handle, uint32_t ev_size)
+{
+	budget_t *budget = &handle->budget;
+
+	budget->events -= 1.0;
+	budget->bytes -= ev_size;
+}
+
+static inline LV2_Atom_Long *
+_inspector_tuple_head(handle_t *handle, int64_t frame, uint32_t nsamples)
+{
+	craft_t *notify = &handle->notify;
+	LV2_Atom_Forge_Ref ref = 0;
+
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_frame_time(&notify->forge, 0);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_tuple(&notify->forge, &notify->frame[1]);
+	if(notify->ref)
+		notify->ref = ref = lv2_atom_forge_long(&notify->forge, frame);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_int(&notify->forge, nsamples);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_sequence_head(&notify->forge, &notify->frame[2], 0);
+
+	// frame offset may only be known at the end of the cycle, patch it in later
+	return notify->ref
+		? (LV2_Atom_Long *)lv2_atom_forge_deref(&notify->forge, ref)
+		: NULL;
+}
+
+static inline int64_t
+_probe_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+static inline void
+_inspector_probe_reset(handle_t *handle)
+{
+	probe_t *probe = &handle->probe;
+
+	probe->elapsed = 0;
+	probe->runs = 0;
+	probe->run_sum = 0;
+	probe->run_min = INT64_MAX;
+	probe->run_max = INT64_MIN;
+	probe->jitters = 0;
+	probe->jitter_sum = 0;
+	probe->jitter_min = INT64_MAX;
+	probe->jitter_max = INT64_MIN;
+}
+
+// rt-safe, at the start of run()
+static inline void
+_inspector_probe_begin(handle_t *handle, uint32_t nsamples)
+{
+	probe_t *probe = &handle->probe;
+	const int64_t now = _probe_now();
+
+	if(probe->start) // not the first call
+	{
+		const int64_t jitter = now - probe->start - probe->period;
+
+		probe->jitters += 1;
+		probe->jitter_sum += jitter;
+		if(jitter < probe->jitter_min)
+			probe->jitter_min = jitter;
+		if(jitter > probe->jitter_max)
+			probe->jitter_max = jitter;
+	}
+
+	probe->start = now;
+	probe->period = nsamples * 1e9 / handle->rate;
+	probe->elapsed += nsamples;
+}
+
+// rt-safe, at the end of run()
+static inline void
+_inspector_probe_end(handle_t *handle)
+{
+	probe_t *probe = &handle->probe;
+	const int64_t cost = _probe_now() - probe->start;
+
+	probe->runs += 1;
+	probe->run_sum += cost;
+	if(cost < probe->run_min)
+		probe->run_min = cost;
+	if(cost > probe->run_max)
+		probe->run_max = cost;
+}
+
+// rt-safe, values of current measurement window, all zero without any cycle
+static inline void
+_inspector_probe_values(handle_t *handle, int64_t vals [PROBE_MAX])
+{
+	const probe_t *probe = &handle->probe;
+
+	memset(vals, 0x0, PROBE_MAX*sizeof(int64_t));
+
+	if(probe->runs)
+	{
+		vals[PROBE_RUN_MIN] = probe->run_min;
+		vals[PROBE_RUN_MEAN] = probe->run_sum / probe->runs;
+		vals[PROBE_RUN_MAX] = probe->run_max;
+	}
+
+	if(probe->jitters)
+	{
+		vals[PROBE_JITTER_MIN] = probe->jitter_min;
+		vals[PROBE_JITTER_MEAN] = probe->jitter_sum / probe->jitters;
+		vals[PROBE_JITTER_MAX] = probe->jitter_max;
+	}
+}
+
+// rt-safe, whether the current window would show up differently in the UI
+static inline bool
+_inspector_probe_changed(handle_t *handle)
+{
+	int64_t vals [PROBE_MAX];
+
+	_inspector_probe_values(handle, vals);
+
+	for(unsigned i = 0; i < PROBE_MAX; i++)
+	{
+		if(llround(vals[i]*1e-3) != handle->probe.sent[i])
+			return true;
+	}
+
+	return false;
+}
+
+// rt-safe, closes the measurement window with the tuple it is sent with
+static inline void
+_inspector_probe_forge(handle_t *handle)
+{
+	craft_t *notify = &handle->notify;
+	probe_t *probe = &handle->probe;
+	int64_t vals [PROBE_MAX];
+
+	_inspector_probe_values(handle, vals);
+
+	for(unsigned i = 0; i < PROBE_MAX; i++)
+		probe->sent[i] = llround(vals[i]*1e-3);
+
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_vector(&notify->forge, sizeof(int64_t), notify->forge.Long,
+			PROBE_MAX, vals);
+
+	_inspector_probe_reset(handle);
+}
+
+static inline void
+_inspector_tuple_tail(handle_t *handle)
+{
+	craft_t *notify = &handle->notify;
+
+	if(notify->ref)
+		lv2_atom_forge_pop(&notify->forge, &notify->frame[2]);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_long(&notify->forge, handle->dropped);
+	if(notify->ref)
+		notify->ref = lv2_atom_forge_long(&notify->forge, handle->skipped);
+	_inspector_probe_forge(handle);
+	if(notify->ref)
+		lv2_atom_forge_pop(&notify->forge, &notify->frame[1]);
+
+	handle->dropped_sent = handle->dropped;
+	handle->skipped_sent = handle->skipped;
+}
+
+// QoS reserve, shrinks with small notify ports so data events still get through
+static inline uint32_t
+_inspector_reserve(handle_t *handle)
+{
+	const uint32_t quarter = handle->notify.forge.size / 4;
+
+	return quarter < QOS_RESERVE ? quarter : QOS_RESERVE;
+}
+
+// size of the largest tuple data events may ever occupy, beside notify and reply sequence headers
+static inline uint32_t
+_inspector_capacity(handle_t *handle)
+{
+	const uint32_t overhead = 2*sizeof(LV2_Atom_Sequence) + _inspector_reserve(handle);
+
+	return handle->notify.forge.size > overhead
+		? handle->notify.forge.size - overhead
+		: 0;
+}
+
+// whether size bytes still fit while leaving room for staged patch replies,
+// plus the QoS reserve unless it is a priority event
+static inline bool
+_inspector_fits(handle_t *handle, uint32_t size, bool priority)
+{
+	const LV2_Atom_Forge *forge = &handle->notify.forge;
+	const uint32_t reserve = handle->reply.forge.offset
+		+ (priority ? 0 : _inspector_reserve(handle));
+
+	return handle->notify.ref
+		&& (forge->offset + size + reserve <= forge->size);
+}
+
+// rt-safe, sends changed counters and a due probe in a tuple without events
+static inline void
+_inspector_counters(handle_t *handle, uint32_t nsamples)
+{
+	if(  (handle->dropped == handle->dropped_sent) && (handle->skipped == handle->skipped_sent)
+		&& ( (handle->probe.elapsed < PROBE_PERIOD * handle->rate) || !_inspector_probe_changed(handle) ) )
+	{
+		return;
+	}
+
+	if(!_inspector_fits(handle, TUPLE_SIZE, true))
+		return; // try again next cycle
+
+	LV2_Atom_Long *offset = _inspector_tuple_head(handle, handle->frame, nsamples);
+
+	if(offset)
+		_inspector_tuple_tail(handle);
+}
+
+// rt-safe, adds a MIDI event to the packed tuple of this cycle, if it fits
+static inline bool
+_inspector_pack(handle_t *handle, const LV2_Atom_Event *ev)
+{
+	pack_t *pack = &handle->pack;
+	const uint32_t size = ev->body.size;
+	const bool spill = size > 3;
+	const uint32_t spill_size = pack->spill + (spill ? size : 0);
+	const uint32_t need = TUPLE_SIZE + sizeof(LV2_Atom_Vector) + sizeof(LV2_Atom)
+		+ (pack->n + 1)*sizeof(packed_midi_t) + lv2_atom_pad_size(spill_size);
+	const uint8_t *msg = LV2_ATOM_BODY_CONST(&ev->body);
+
+	// collapse into the run of the previous record, if there is any
+	if(!spill && pack->n)
+	{
+		packed_midi_t *prev = &pack->records[pack->n - 1];
+		const bool run = prev->size == PACK_REPEAT;
+		const packed_midi_t *first = run ? prev - 1 : prev;
+
+		if( (first->size == size) && !memcmp(first->data, msg, size) )
+		{
+			const uint32_t count = run
+				? prev->data[0] | (prev->data[1] << 8) | (prev->data[2] << 16)
+				: 0;
+
+			if(run && (count < PACK_REPEAT_MAX) )
+			{
+				prev->frames = ev->time.frames;
+				prev->data[0] = (count + 1) & 0xff;
+				prev->data[1] = ((count + 1) >> 8) & 0xff;
+				prev->data[2] = ((count + 1) >> 16) & 0xff;
+
+				return true;
+			}
+
+			if(!run && (pack->n < PACK_MAX) && _inspector_fits(handle, need, false) )
+			{
+				packed_midi_t *rec = &pack->records[pack->n++];
+				rec->frames = ev->time.frames;
+				rec->data[0] = 1;
+				rec->data[1] = 0;
+				rec->data[2] = 0;
+				rec->size = PACK_REPEAT;
+
+				return true;
+			}
+		}
+	}
+
+	if(  !size || (pack->n >= PACK_MAX) || (spill_size > PACK_SPILL_SIZE)
+		|| !_inspector_fits(handle, need, false) )
+	{
+		return false;
+	}
+
+	packed_midi_t *rec = &pack->records[pack->n++];
+	rec->frames = ev->time.frames;
+
+	if(spill)
+	{
+		rec->data[0] = size & 0xff;
+		rec->data[1] = (size >> 8) & 0xff;
+		rec->data[2] = (size >> 16) & 0xff;
+		rec->size = 0;
+
+		memcpy(&pack->spill_buf[pack->spill], msg, size);
+		pack->spill = spill_size;
+	}
+	else
+	{
+		rec->data[0] = msg[0];
+		rec->data[1] = size > 1 ? msg[1] : 0;
+		rec->data[2] = size > 2 ? msg[2] : 0;
+		rec->size = size;
+	}
+
+	return true;
+}
+
+// rt-safe, walks the control sequence exactly once, packed is for MIDI only
+static inline void
+_inspector_run(handle_t *handle, uint32_t nsamples, inspector_filter_t filter,
+	bool packed)
+{
+	craft_t *through = &handle->through;
+	craft_t *notify = &handle->notify;
+	craft_t *reply = &handle->reply;
+
+	_inspector_probe_begin(handle, nsamples);
+
+	// through port is a verbatim copy of the control port
+	if(through->seq != handle->control) // nothing to do when host runs us in-place
+	{
+		const uint32_t capacity = through->seq->atom.size;
+		const uint32_t size = lv2_atom_total_size(&handle->control->atom);
+
+		if(size <= capacity)
+		{
+			memcpy(through->buf, handle->control, size);
+		}
+		else
+		{
+			lv2_atom_sequence_clear(through->seq);
+
+			if(handle->log)
+				lv2_log_trace(&handle->logger, "through buffer overflow\n");
+		}
+	}
+
+	const uint32_t capacity = notify->seq->atom.size;
+	lv2_atom_forge_set_buffer(&notify->forge, notify->buf, capacity);
+	notify->ref = lv2_atom_forge_sequence_head(&notify->forge, &notify->frame[0], 0);
+
+	// patch replies are staged, as the notify tuple may be open while they arrive
+	lv2_atom_forge_set_buffer(&reply->forge, reply->buf, REPLY_SIZE);
+	reply->ref = lv2_atom_forge_sequence_head(&reply->forge, &reply->frame[0], 0);
+
+	props_idle(&handle->props, &notify->forge, 0, &notify->ref);
+
+	// events deferred in earlier cycles go first
+	uint32_t nforwarded = handle->backlog
+		? _inspector_trickle(handle)
+		: 0;
+
+	// then the next piece of an oversized event
+	if(handle->stage.size)
+		_inspector_fragment(handle);
+
+	const uint32_t max_size = _inspector_capacity(handle);
+
+	const bool lossless = handle->state.lossless && handle->sched;
+	const bool stats = handle->state.stats;
+	const bool budget = _inspector_budget_refill(handle, nsamples);
+	LV2_Atom_Long *offset = NULL;
+
+	LV2_ATOM_SEQUENCE_FOREACH(handle->control, ev)
+	{
+		const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
+		const int64_t frames = ev->time.frames;
+		const bool position = lv2_atom_forge_is_object_type(&notify->forge, obj->atom.type)
+			&& (obj->body.otype == handle->time_position);
+
+		if(!props_advance(&handle->props, &reply->forge, frames, obj, &reply->ref) && position)
+			_inspector_transport(handle, obj, frames);
+
+		// only serialize filtered events to UI
+		const LV2_Atom_Event *fwd = filter(handle, ev);
+		if(!fwd)
+			continue;
+
+		const uint32_t ev_size = sizeof(LV2_Atom_Event) + fwd->body.size;
+		const uint32_t need = lv2_atom_pad_size(ev_size) + (offset ? TUPLE_TAIL_SIZE : TUPLE_SIZE);
+
+		if(handle->recording)
+			_inspector_record(handle, fwd, ev_size, nsamples);
+
+		// only count events, the summary is sent once per period
+		if(stats)
+		{
+			_inspector_stats_add(handle, fwd);
+			continue;
+		}
+
+		// held back events are gone for good, also in lossless mode
+		if(budget && !_inspector_budget(handle))
+		{
+			handle->skipped += 1;
+			continue;
+		}
+
+		// would never fit into a tuple
+		if(lv2_atom_pad_size(ev_size) + TUPLE_SIZE > max_size)
+		{
+			if(_inspector_stage(handle, fwd, ev_size, nsamples) && budget)
+				_inspector_budget_take(handle, ev_size);
+			continue;
+		}
+
+		// keep ordering by deferring everything while there is a backlog
+		if(lossless && (handle->backlog || !_inspector_fits(handle, need, false)) )
+		{
+			if(_inspector_defer(handle, fwd, ev_size, nsamples) && budget)
+				_inspector_budget_take(handle, ev_size);
+			continue;
+		}
+
+		if(packed)
+		{
+			bool sent = false;
+
+			if(_inspector_pack(handle, fwd))
+			{
+				nforwarded += 1;
+				sent = true;
+			}
+			else if(lossless)
+				sent = _inspector_defer(handle, fwd, ev_size, nsamples);
+			else
+				handle->dropped += 1;
+
+			if(sent && budget)
+				_inspector_budget_take(handle, ev_size);
+
+			continue;
+		}
+
+		// truncate at event boundary, transport may still use the reserve
+		if(!_inspector_fits(handle, need, position))
+		{
+			handle->dropped += 1;
+			continue;
+		}
+
+		if(!offset)
+			offset = _inspector_tuple_head(handle, handle->frame, nsamples);
+
+		if(notify->ref)
+			notify->ref = lv2_atom_forge_raw(&notify->forge, fwd, ev_size);
+		if(notify->ref)
+			lv2_atom_forge_pad(&notify->forge, ev_size);
+
+		if(budget)
+			_inspector_budget_take(handle, ev_size);
+
+		nforwarded += 1;
+	}
+
+	if(offset) // there were filtered events
+	{
+		offset->body = handle->frame;
+
+		_inspector_tuple_tail(handle);
+	}
+
+	if(packed && handle->pack.n)
+		_inspector_pack_flush(handle, nsamples);
+
+	_inspector_counters(handle, nsamples);
+
+	if(stats)
+		_inspector_stats(handle, nsamples);
+	else if(handle->stats.cycles) // mode left, drop partial period
+		_inspector_stats_reset(handle);
+
+	if(reply->ref)
+	{
+		lv2_atom_forge_pop(&reply->forge, &reply->frame[0]);
+
+		LV2_ATOM_SEQUENCE_FOREACH(reply->seq, ev)
+		{
+			const uint32_t size = sizeof(LV2_Atom) + ev->body.size;
+
+			// a reply which does not fit is lost, but the rest of the cycle is not
+			if(notify->forge.offset + sizeof(LV2_Atom_Event) + size > notify->forge.size)
+			{
+				if(handle->log)
+					lv2_log_trace(&handle->logger, "reply does not fit\n");
+				break;
+			}
+
+			if(notify->ref)
+				notify->ref = lv2_atom_forge_frame_time(&notify->forge, ev->time.frames);
+			if(notify->ref)
+				notify->ref = lv2_atom_forge_write(&notify->forge, &ev->body, size);
+		}
+	}
+	else if(handle->log)
+	{
+		lv2_log_trace(&handle->logger, "reply buffer overflow\n");
+	}
+
+	if(notify->ref)
+		lv2_atom_forge_pop(&notify->forge, &notify->frame[0]);
+	else
+	{
+		lv2_atom_sequence_clear(notify->seq);
+		handle->dropped += nforwarded;
+
+		if(handle->log)
+			lv2_log_trace(&handle->logger, "notify buffer overflow\n");
+	}
+
+	// let worker move deferred events along, emit trace and write records
+	if( (handle->backlog || handle->traced || handle->recorded) && handle->sched)
+	{
+		const uint32_t job = JOB_DRAIN;
+
+		handle->sched->schedule_work(handle->sched->handle, sizeof(job), &job);
+		handle->traced = false;
+		handle->recorded = false;
+	}
+
+	handle->frame += nsamples;
+	handle->counter += 1;
+
+	if(handle->transport.valid)
+		handle->transport.frame += nsamples * handle->transport.speed;
+
+	_inspector_probe_end(handle);
+}
+
 // there is a bug in LV2 <= 0.10
 #if defined(LV2_ATOM_TUPLE_FOREACH)
 #	undef LV2_ATOM_TUPLE_FOREACH
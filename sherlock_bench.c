@@ -0,0 +1,409 @@
+/*
+ * Copyright (c) 2015-2016 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <getopt.h>
+
+#include <sherlock.h>
+
+#include <osc.lv2/forge.h>
+
+#define MAX_URIDS 512
+#define SEQ_SIZE 0x100000
+
+typedef struct _bench_t bench_t;
+typedef void (*bench_fill_t)(bench_t *bench, LV2_Atom_Forge *forge, uint32_t nevents);
+
+struct _bench_t {
+	char *uris [MAX_URIDS];
+	uint32_t nuris;
+
+	LV2_URID_Map map;
+	LV2_URID_Unmap unmap;
+	LV2_Log_Log log;
+	LV2_OSC_URID osc_urid;
+
+	uint32_t nsamples;
+	uint32_t ncycles;
+	uint32_t nevents;
+	uint32_t chunk_size;
+	uint32_t notify_size;
+
+	uint8_t *control;
+	uint8_t *through;
+	uint8_t *notify;
+};
+
+static LV2_URID
+_map(LV2_URID_Map_Handle instance, const char *uri)
+{
+	bench_t *bench = instance;
+
+	for(uint32_t i = 0; i < bench->nuris; i++)
+	{
+		if(!strcmp(bench->uris[i], uri))
+			return i + 1;
+	}
+
+	if(bench->nuris >= MAX_URIDS)
+		return 0;
+
+	bench->uris[bench->nuris++] = strdup(uri);
+	return bench->nuris;
+}
+
+static const char *
+_unmap(LV2_URID_Unmap_Handle instance, LV2_URID urid)
+{
+	bench_t *bench = instance;
+
+	if( (urid == 0) || (urid > bench->nuris) )
+		return NULL;
+
+	return bench->uris[urid - 1];
+}
+
+static int
+_vprintf(LV2_Log_Handle instance, LV2_URID type, const char *fmt, va_list args)
+{
+	return 0; // log output would dominate timing
+}
+
+static int
+_printf(LV2_Log_Handle instance, LV2_URID type, const char *fmt, ...)
+{
+	return 0;
+}
+
+static void
+_fill_midi(bench_t *bench, LV2_Atom_Forge *forge, uint32_t nevents)
+{
+	const LV2_URID midi_event = _map(bench, LV2_MIDI__MidiEvent);
+
+	for(uint32_t i = 0; i < nevents; i++)
+	{
+		const uint8_t msg [3] = {
+			(i % 2 ? LV2_MIDI_MSG_NOTE_OFF : LV2_MIDI_MSG_NOTE_ON) | (i % 16),
+			i % 128,
+			0x7f
+		};
+
+		lv2_atom_forge_frame_time(forge, i * bench->nsamples / nevents);
+		lv2_atom_forge_atom(forge, sizeof(msg), midi_event);
+		lv2_atom_forge_write(forge, msg, sizeof(msg));
+	}
+}
+
+static void
+_fill_osc(bench_t *bench, LV2_Atom_Forge *forge, uint32_t nevents)
+{
+	const LV2_OSC_Timetag timetag = { .integral = 0, .fraction = 1 };
+
+	for(uint32_t i = 0; i < nevents; i++)
+	{
+		LV2_Atom_Forge_Frame frame [2];
+
+		lv2_atom_forge_frame_time(forge, i * bench->nsamples / nevents);
+		lv2_osc_forge_bundle_head(forge, &bench->osc_urid, frame, &timetag);
+		lv2_osc_forge_message_vararg(forge, &bench->osc_urid, "/touch/1/x", "f", 0.5f);
+		lv2_osc_forge_message_vararg(forge, &bench->osc_urid, "/touch/1/y", "f", 0.5f);
+		lv2_osc_forge_message_vararg(forge, &bench->osc_urid, "/touch/1/z", "if", 1, 0.25f);
+		lv2_osc_forge_message_vararg(forge, &bench->osc_urid, "/status", "s", "pressed");
+		lv2_atom_forge_pop(forge, &frame[1]);
+		lv2_atom_forge_pop(forge, &frame[0]);
+	}
+}
+
+static void
+_fill_patch(bench_t *bench, LV2_Atom_Forge *forge, uint32_t nevents)
+{
+	const LV2_URID patch_set = _map(bench, LV2_PATCH__Set);
+	const LV2_URID patch_property = _map(bench, LV2_PATCH__property);
+	const LV2_URID patch_value = _map(bench, LV2_PATCH__value);
+	const LV2_URID property = _map(bench, "urn:sherlock:bench#gain");
+
+	for(uint32_t i = 0; i < nevents; i++)
+	{
+		LV2_Atom_Forge_Frame frame;
+
+		lv2_atom_forge_frame_time(forge, i * bench->nsamples / nevents);
+		lv2_atom_forge_object(forge, &frame, 0, patch_set);
+		lv2_atom_forge_key(forge, patch_property);
+		lv2_atom_forge_urid(forge, property);
+		lv2_atom_forge_key(forge, patch_value);
+		lv2_atom_forge_float(forge, (float)i / nevents);
+		lv2_atom_forge_pop(forge, &frame);
+	}
+}
+
+static void
+_fill_chunk(bench_t *bench, LV2_Atom_Forge *forge, uint32_t nevents)
+{
+	for(uint32_t i = 0; i < nevents; i++)
+	{
+		lv2_atom_forge_frame_time(forge, i * bench->nsamples / nevents);
+		lv2_atom_forge_atom(forge, bench->chunk_size, forge->Chunk);
+		for(uint32_t j = 0; j < bench->chunk_size; j++)
+		{
+			const uint8_t byte = j;
+			lv2_atom_forge_raw(forge, &byte, 1);
+		}
+		lv2_atom_forge_pad(forge, bench->chunk_size);
+	}
+}
+
+static void
+_set_defaults(bench_t *bench, LV2_Atom_Forge *forge)
+{
+	const LV2_URID patch_set = _map(bench, LV2_PATCH__Set);
+	const LV2_URID patch_property = _map(bench, LV2_PATCH__property);
+	const LV2_URID patch_value = _map(bench, LV2_PATCH__value);
+	LV2_Atom_Forge_Frame frame;
+
+	// mirror default state of atom inspector
+	lv2_atom_forge_frame_time(forge, 0);
+	lv2_atom_forge_object(forge, &frame, 0, patch_set);
+	lv2_atom_forge_key(forge, patch_property);
+	lv2_atom_forge_urid(forge, _map(bench, SHERLOCK_URI"#filter"));
+	lv2_atom_forge_key(forge, patch_value);
+	lv2_atom_forge_urid(forge, _map(bench, LV2_TIME__Position));
+	lv2_atom_forge_pop(forge, &frame);
+
+	lv2_atom_forge_frame_time(forge, 0);
+	lv2_atom_forge_object(forge, &frame, 0, patch_set);
+	lv2_atom_forge_key(forge, patch_property);
+	lv2_atom_forge_urid(forge, _map(bench, SHERLOCK_URI"#negate"));
+	lv2_atom_forge_key(forge, patch_value);
+	lv2_atom_forge_bool(forge, true);
+	lv2_atom_forge_pop(forge, &frame);
+}
+
+static void
+_run(bench_t *bench, const LV2_Descriptor *desc, LV2_Handle instance,
+	LV2_Atom_Forge *forge, bench_fill_t fill, uint32_t nevents)
+{
+	LV2_Atom_Forge_Frame frame;
+
+	lv2_atom_forge_set_buffer(forge, bench->control, SEQ_SIZE);
+	lv2_atom_forge_sequence_head(forge, &frame, 0);
+	if(fill)
+		fill(bench, forge, nevents);
+	else
+		_set_defaults(bench, forge);
+	lv2_atom_forge_pop(forge, &frame);
+
+	// hosts reset capacity of output ports before each cycle
+	((LV2_Atom *)bench->through)->size = SEQ_SIZE - sizeof(LV2_Atom);
+	((LV2_Atom *)bench->notify)->size = bench->notify_size - sizeof(LV2_Atom);
+
+	desc->run(instance, bench->nsamples);
+}
+
+static inline double
+_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void
+_bench(bench_t *bench, const LV2_Descriptor *desc, const char *name, bench_fill_t fill)
+{
+	const LV2_Feature map_feature = { .URI = LV2_URID__map, .data = &bench->map };
+	const LV2_Feature unmap_feature = { .URI = LV2_URID__unmap, .data = &bench->unmap };
+	const LV2_Feature log_feature = { .URI = LV2_LOG__log, .data = &bench->log };
+	const LV2_Feature *const features [] = {
+		&map_feature, &unmap_feature, &log_feature, NULL
+	};
+	LV2_Atom_Forge forge;
+
+	lv2_atom_forge_init(&forge, &bench->map);
+
+	LV2_Handle instance = desc->instantiate(desc, 48000.0, "", features);
+	if(!instance)
+	{
+		fprintf(stderr, "failed to instantiate %s\n", desc->URI);
+		return;
+	}
+
+	desc->connect_port(instance, 0, bench->control);
+	desc->connect_port(instance, 1, bench->through);
+	desc->connect_port(instance, 2, bench->notify);
+
+	_run(bench, desc, instance, &forge, NULL, 0);
+	for(uint32_t i = 0; i < 16; i++) // warm up caches
+		_run(bench, desc, instance, &forge, fill, bench->nevents);
+
+	// input is forged once, run() treats control port as read-only
+	double elapsed = 0.0;
+	uint64_t notify_bytes = 0;
+
+	for(uint32_t i = 0; i < bench->ncycles; i++)
+	{
+		((LV2_Atom *)bench->through)->size = SEQ_SIZE - sizeof(LV2_Atom);
+		((LV2_Atom *)bench->notify)->size = bench->notify_size - sizeof(LV2_Atom);
+
+		const double t0 = _now();
+		desc->run(instance, bench->nsamples);
+		elapsed += _now() - t0;
+
+		notify_bytes += ((LV2_Atom *)bench->notify)->size;
+	}
+
+	desc->cleanup(instance);
+
+	const double ns_per_cycle = elapsed / bench->ncycles;
+	printf("%-16s %-6s %10"PRIu32" %10.1f %10.1f %14.1f\n",
+		desc->URI + strlen(SHERLOCK_URI"#"), name, bench->nevents,
+		ns_per_cycle / bench->nevents, ns_per_cycle,
+		(double)notify_bytes / bench->ncycles);
+}
+
+static void
+_usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-b nsamples] [-c cycles] [-n events/cycle] [-s chunk size]\n"
+		"       [-m notify size] [-w midi|osc|patch|chunk]\n", name);
+}
+
+int
+main(int argc, char **argv)
+{
+	static bench_t bench;
+	const char *workload = NULL;
+	int c;
+
+	bench.nsamples = 128;
+	bench.ncycles = 10000;
+	bench.nevents = 64;
+	bench.chunk_size = 1024;
+	bench.notify_size = 0x10000;
+
+	while((c = getopt(argc, argv, "b:c:n:s:m:w:h")) != -1)
+	{
+		switch(c)
+		{
+			case 'b':
+				bench.nsamples = atoi(optarg);
+				break;
+			case 'c':
+				bench.ncycles = atoi(optarg);
+				break;
+			case 'n':
+				bench.nevents = atoi(optarg);
+				break;
+			case 's':
+				bench.chunk_size = atoi(optarg);
+				break;
+			case 'm':
+				bench.notify_size = atoi(optarg);
+				break;
+			case 'w':
+				workload = optarg;
+				break;
+			case 'h':
+			default:
+				_usage(argv[0]);
+				return c == 'h' ? 0 : -1;
+		}
+	}
+
+	if( (bench.nsamples == 0) || (bench.ncycles == 0) || (bench.nevents == 0)
+		|| (bench.notify_size < 0x100) )
+	{
+		fprintf(stderr, "invalid arguments\n");
+		return -1;
+	}
+
+	const struct {
+		const char *name;
+		bench_fill_t fill;
+	} workloads [] = {
+		{ "midi", _fill_midi },
+		{ "osc", _fill_osc },
+		{ "patch", _fill_patch },
+		{ "chunk", _fill_chunk },
+		{ NULL, NULL }
+	};
+
+	if(workload)
+	{
+		unsigned w = 0;
+
+		while(workloads[w].name && strcmp(workload, workloads[w].name))
+			w++;
+
+		if(!workloads[w].name)
+		{
+			fprintf(stderr, "unknown workload: %s\n", workload);
+			_usage(argv[0]);
+			return -1;
+		}
+	}
+
+	bench.map.handle = &bench;
+	bench.map.map = _map;
+	bench.unmap.handle = &bench;
+	bench.unmap.unmap = _unmap;
+	bench.log.handle = &bench;
+	bench.log.printf = _printf;
+	bench.log.vprintf = _vprintf;
+	lv2_osc_urid_init(&bench.osc_urid, &bench.map);
+
+	bench.control = aligned_alloc(8, SEQ_SIZE);
+	bench.through = aligned_alloc(8, SEQ_SIZE);
+	bench.notify = aligned_alloc(8, bench.notify_size);
+	if(!bench.control || !bench.through || !bench.notify)
+	{
+		fprintf(stderr, "out of memory\n");
+		return -1;
+	}
+
+	const LV2_Descriptor *descs [] = {
+		&atom_inspector,
+		&midi_inspector,
+		&osc_inspector,
+		NULL
+	};
+
+	printf("%-16s %-6s %10s %10s %10s %14s\n",
+		"plugin", "load", "ev/cycle", "ns/event", "ns/cycle", "notify B/cycle");
+
+	for(unsigned w = 0; workloads[w].name; w++)
+	{
+		if(workload && strcmp(workload, workloads[w].name))
+			continue;
+
+		for(unsigned d = 0; descs[d]; d++)
+			_bench(&bench, descs[d], workloads[w].name, workloads[w].fill);
+	}
+
+	free(bench.control);
+	free(bench.through);
+	free(bench.notify);
+	for(uint32_t i = 0; i < bench.nuris; i++)
+		free(bench.uris[i]);
+
+	return 0;
+}
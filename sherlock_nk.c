@@ -78,6 +78,32 @@ _set_bool(plughandle_t *handle, LV2_URID property, int32_t val)
 	}
 }
 
+void
+_set_int(plughandle_t *handle, LV2_URID property, int32_t val)
+{
+	ser_atom_t ser;
+
+	if(ser_atom_init(&ser) == 0)
+	{
+		LV2_Atom_Forge_Frame frame;
+
+		ser_atom_reset(&ser, &handle->forge);
+		lv2_atom_forge_object(&handle->forge, &frame, 0, handle->props.urid.patch_set);
+		lv2_atom_forge_key(&handle->forge, handle->props.urid.patch_property);
+		lv2_atom_forge_urid(&handle->forge, property);
+
+		lv2_atom_forge_key(&handle->forge, handle->props.urid.patch_value);
+		lv2_atom_forge_int(&handle->forge, val);
+
+		lv2_atom_forge_pop(&handle->forge, &frame);
+
+		handle->write_function(handle->controller, 0, lv2_atom_total_size(ser_atom_get(&ser)),
+			handle->event_transfer, ser_atom_get(&ser));
+
+		ser_atom_deinit(&ser);
+	}
+}
+
 void
 _set_urid(plughandle_t *handle, LV2_URID property, uint32_t val)
 {
@@ -104,6 +130,145 @@ _set_urid(plughandle_t *handle, LV2_URID property, uint32_t val)
 	}
 }
 
+void
+_set_urids(plughandle_t *handle, LV2_URID property, uint32_t n, const LV2_URID *vals)
+{
+	ser_atom_t ser;
+
+	if(ser_atom_init(&ser) == 0)
+	{
+		LV2_Atom_Forge_Frame frame;
+
+		ser_atom_reset(&ser, &handle->forge);
+		lv2_atom_forge_object(&handle->forge, &frame, 0, handle->props.urid.patch_set);
+		lv2_atom_forge_key(&handle->forge, handle->props.urid.patch_property);
+		lv2_atom_forge_urid(&handle->forge, property);
+
+		lv2_atom_forge_key(&handle->forge, handle->props.urid.patch_value);
+		lv2_atom_forge_vector(&handle->forge, sizeof(LV2_URID), handle->forge.URID, n, vals);
+
+		lv2_atom_forge_pop(&handle->forge, &frame);
+
+		handle->write_function(handle->controller, 0, lv2_atom_total_size(ser_atom_get(&ser)),
+			handle->event_transfer, ser_atom_get(&ser));
+
+		ser_atom_deinit(&ser);
+	}
+}
+
+void
+_set_chunk(plughandle_t *handle, LV2_URID property, uint32_t size, const void *body)
+{
+	ser_atom_t ser;
+
+	if(ser_atom_init(&ser) == 0)
+	{
+		LV2_Atom_Forge_Frame frame;
+
+		ser_atom_reset(&ser, &handle->forge);
+		lv2_atom_forge_object(&handle->forge, &frame, 0, handle->props.urid.patch_set);
+		lv2_atom_forge_key(&handle->forge, handle->props.urid.patch_property);
+		lv2_atom_forge_urid(&handle->forge, property);
+
+		lv2_atom_forge_key(&handle->forge, handle->props.urid.patch_value);
+		lv2_atom_forge_atom(&handle->forge, size, handle->forge.Chunk);
+		lv2_atom_forge_write(&handle->forge, body, size);
+
+		lv2_atom_forge_pop(&handle->forge, &frame);
+
+		handle->write_function(handle->controller, 0, lv2_atom_total_size(ser_atom_get(&ser)),
+			handle->event_transfer, ser_atom_get(&ser));
+
+		ser_atom_deinit(&ser);
+	}
+}
+
+void
+_set_text(plughandle_t *handle, LV2_URID property, const char *str)
+{
+	ser_atom_t ser;
+
+	if(ser_atom_init(&ser) == 0)
+	{
+		LV2_Atom_Forge_Frame frame;
+
+		ser_atom_reset(&ser, &handle->forge);
+		lv2_atom_forge_object(&handle->forge, &frame, 0, handle->props.urid.patch_set);
+		lv2_atom_forge_key(&handle->forge, handle->props.urid.patch_property);
+		lv2_atom_forge_urid(&handle->forge, property);
+
+		lv2_atom_forge_key(&handle->forge, handle->props.urid.patch_value);
+		lv2_atom_forge_string(&handle->forge, str, strlen(str));
+
+		lv2_atom_forge_pop(&handle->forge, &frame);
+
+		handle->write_function(handle->controller, 0, lv2_atom_total_size(ser_atom_get(&ser)),
+			handle->event_transfer, ser_atom_get(&ser));
+
+		ser_atom_deinit(&ser);
+	}
+}
+
+void
+_set_path(plughandle_t *handle, LV2_URID property, const char *str)
+{
+	ser_atom_t ser;
+
+	if(ser_atom_init(&ser) == 0)
+	{
+		LV2_Atom_Forge_Frame frame;
+
+		ser_atom_reset(&ser, &handle->forge);
+		lv2_atom_forge_object(&handle->forge, &frame, 0, handle->props.urid.patch_set);
+		lv2_atom_forge_key(&handle->forge, handle->props.urid.patch_property);
+		lv2_atom_forge_urid(&handle->forge, property);
+
+		lv2_atom_forge_key(&handle->forge, handle->props.urid.patch_value);
+		lv2_atom_forge_path(&handle->forge, str, strlen(str));
+
+		lv2_atom_forge_pop(&handle->forge, &frame);
+
+		handle->write_function(handle->controller, 0, lv2_atom_total_size(ser_atom_get(&ser)),
+			handle->event_transfer, ser_atom_get(&ser));
+
+		ser_atom_deinit(&ser);
+	}
+}
+
+void
+_record_changed(void *data, int64_t frames, props_impl_t *impl)
+{
+	plughandle_t *handle = data;
+
+	handle->record_dirty = true; // editor text is regenerated on next expose
+}
+
+void
+_pattern_changed(void *data, int64_t frames, props_impl_t *impl)
+{
+	plughandle_t *handle = data;
+
+	handle->pattern_dirty = true; // editor text is regenerated on next expose
+}
+
+void
+_filter_changed(void *data, int64_t frames, props_impl_t *impl)
+{
+	plughandle_t *handle = data;
+
+	if(impl->def->offset == offsetof(state_t, predicate))
+	{
+		handle->npredicate = predicate_validate(&handle->state.predicate, impl->value.size);
+		handle->predicate_dirty = true;
+		return;
+	}
+
+	if(impl->def->offset == offsetof(state_t, filters))
+		handle->nfilters = _filters_count(&handle->state.filters, impl->value.size);
+
+	handle->filter_dirty = true; // editor text is regenerated on next expose
+}
+
 void
 _ruler(struct nk_context *ctx, float line_thickness, struct nk_color color)
 {
@@ -131,33 +296,49 @@ _empty(struct nk_context *ctx)
 static void
 _clear_items(plughandle_t *handle)
 {
-	if(handle->items)
-	{
-		for(int i = 0; i < handle->n_item; i++)
-		{
-			item_t *itm = handle->items[i];
-
-			if(itm)
-				free(itm);
-		}
-
-		free(handle->items);
-		handle->items = NULL;
-	}
+	arena_clear(&handle->arena);
 
 	handle->n_item = 0;
+	handle->full = false;
 }
 
+/*
+ * Eviction policy of the item arena, this is the only place it is applied:
+ * - frame lines start a group, holding the events, place holders and markers
+ *   appended after them
+ * - without overwrite mode nothing is evicted, a refused item sets the full
+ *   flag and appending stops until the history is cleared
+ * - in overwrite mode the oldest groups are evicted one at a time until the
+ *   new item fits, the group still being appended to only goes to make room
+ *   for the next frame line
+ * - an item which does not fit into an empty arena is dropped
+ */
 static item_t *
 _append_item(plughandle_t *handle, item_type_t type, size_t sz)
 {
-	handle->items = realloc(handle->items, (handle->n_item + 1)*sizeof(item_t *));
-	handle->items[handle->n_item] = malloc(sizeof(item_t) + sz);
+	const bool mark = type == ITEM_TYPE_FRAME;
+	item_t *itm;
 
-	item_t *itm = handle->items[handle->n_item];
-	itm->type = type;
+	while( !(itm = arena_alloc(&handle->arena, sizeof(item_t) + sz, mark))
+		&& handle->state.overwrite && arena_evict(&handle->arena, !mark) )
+	{
+		// try again with the next group gone
+	}
 
-	handle->n_item += 1;
+	// selection is reset with the item it points to
+	if(handle->selected && (handle->selected_item < arena_id(&handle->arena, 0)) )
+	{
+		handle->selected = NULL;
+		handle->ttl_dirty = true;
+	}
+
+	handle->n_item = arena_count(&handle->arena);
+	handle->full = !itm;
+
+	if(!itm) // item budget used up
+		return NULL;
+
+	itm->type = type;
 
 	return itm;
 }
@@ -271,6 +452,325 @@ _check(struct nk_context *ctx, int32_t state)
 	return state;
 }
 
+void
+_record_edit(plughandle_t *handle, struct nk_context *ctx)
+{
+	// has record path been updated meanwhile ?
+	if(handle->record_dirty)
+	{
+		snprintf(handle->record_path, sizeof(handle->record_path), "%.*s",
+			(int)sizeof(handle->state.record_path), handle->state.record_path);
+		handle->record_dirty = false;
+	}
+
+	const nk_flags flags = NK_EDIT_FIELD
+		| NK_EDIT_AUTO_SELECT
+		| NK_EDIT_SIG_ENTER;
+	const nk_flags mode = nk_edit_string_zero_terminated(ctx, flags,
+		handle->record_path, sizeof(handle->record_path) - 1, nk_filter_ascii);
+	if(mode & NK_EDIT_COMMITED)
+		_set_path(handle, handle->urid.record_path, handle->record_path);
+}
+
+// run() cost and host callback jitter as measured by the plugin, in us
+void
+_probe_view(plughandle_t *handle, struct nk_context *ctx)
+{
+	const int64_t *probe = handle->probe;
+
+	if(probe[PROBE_RUN_MAX] == 0)
+	{
+		_empty(ctx);
+		return;
+	}
+
+	nk_labelf(ctx, NK_TEXT_CENTERED,
+		"run: %.0f/%.0f/%.0f us jitter: %+.0f/%+.0f/%+.0f us",
+		probe[PROBE_RUN_MIN]*1e-3, probe[PROBE_RUN_MEAN]*1e-3, probe[PROBE_RUN_MAX]*1e-3,
+		probe[PROBE_JITTER_MIN]*1e-3, probe[PROBE_JITTER_MEAN]*1e-3, probe[PROBE_JITTER_MAX]*1e-3);
+}
+
+// transport discontinuity, spans the whole row like a frame line
+void
+_marker_view(plughandle_t *handle, struct nk_context *ctx, const item_t *itm)
+{
+	struct nk_command_buffer *canvas = nk_window_get_canvas(ctx);
+	const struct nk_vec2 group_padding = ctx->style.window.group_padding;
+	const int32_t flags = itm->marker.flags;
+	const char *what = flags & TRANSPORT_JUMP
+		? "jump"
+		: (flags & TRANSPORT_REWIND
+			? "rewind"
+			: "speed");
+
+	nk_layout_row_dynamic(ctx, handle->dy, 3);
+	{
+		struct nk_rect b = nk_widget_bounds(ctx);
+		b.x -= group_padding.x;
+		b.w *= 3;
+		b.w += 4*group_padding.x;
+		nk_fill_rect(canvas, b, 0.f, nk_rgb(0x38, 0x10, 0x10));
+	}
+
+	if(flags & (TRANSPORT_JUMP | TRANSPORT_REWIND) )
+	{
+		nk_labelf_colored(ctx, NK_TEXT_LEFT, red, "%s %+"PRIi64" @%"PRIi64,
+			what, itm->marker.frame - itm->marker.expected, itm->marker.frame);
+	}
+	else
+	{
+		nk_labelf_colored(ctx, NK_TEXT_LEFT, red, "%s @%"PRIi64, what, itm->marker.frame);
+	}
+	nk_labelf_colored(ctx, NK_TEXT_CENTERED, green, "%"PRIi64":%.2f",
+		itm->marker.bar + 1, itm->marker.bar_beat + 1.f);
+	nk_labelf_colored(ctx, NK_TEXT_RIGHT, violet, "%.1f bpm x%.2f",
+		itm->marker.bpm, itm->marker.speed);
+
+	handle->shadow = false;
+}
+
+void
+_stats_view(plughandle_t *handle, struct nk_context *ctx)
+{
+	const summary_t *sum = &handle->summary;
+	const float widget_h = handle->dy;
+
+	if(!nk_group_begin(ctx, "Stats", NK_WINDOW_BORDER))
+		return;
+
+	const float ratio [2] = {0.3f, 0.7f};
+	nk_layout_row(ctx, NK_DYNAMIC, widget_h, 2, ratio);
+	nk_label(ctx, "period", NK_TEXT_LEFT);
+	const int32_t stats_period = nk_propertyi(ctx, "#cycles",
+		1, handle->state.stats_period, 65536, 1, 1.f);
+	if(stats_period != handle->state.stats_period)
+	{
+		handle->state.stats_period = stats_period;
+		_set_int(handle, handle->urid.stats_period, handle->state.stats_period);
+	}
+
+	if(sum->cycles > 0)
+	{
+		const double seconds = sum->seconds > 0.0
+			? sum->seconds
+			: 1.0;
+		const char *largest = sum->largest_type
+			? handle->unmap->unmap(handle->unmap->handle, sum->largest_type)
+			: NULL;
+
+		nk_layout_row(ctx, NK_DYNAMIC, widget_h, 2, ratio);
+		nk_label(ctx, "events", NK_TEXT_LEFT);
+		nk_labelf(ctx, NK_TEXT_LEFT, "%"PRIi64" (%.0f/s, %.1f/cycle, peak %"PRIi32")",
+			sum->events, sum->events / seconds, (double)sum->events / sum->cycles, sum->peak);
+
+		nk_label(ctx, "bytes", NK_TEXT_LEFT);
+		nk_labelf(ctx, NK_TEXT_LEFT, "%"PRIi64" (%.0f/s)",
+			sum->bytes, sum->bytes / seconds);
+
+		nk_label(ctx, "frame offsets", NK_TEXT_LEFT);
+		nk_labelf(ctx, NK_TEXT_LEFT, "%"PRIi64" - %"PRIi64,
+			sum->min_frames, sum->max_frames);
+
+		nk_label(ctx, "largest event", NK_TEXT_LEFT);
+		nk_labelf(ctx, NK_TEXT_LEFT, "%"PRIi32" (%s)",
+			sum->largest, largest ? largest : "-");
+
+		nk_layout_row_dynamic(ctx, widget_h/2, 1);
+		_ruler(ctx, 1.f, nk_rgb(0x88, 0x88, 0x88));
+
+		const float table [3] = {0.6f, 0.2f, 0.2f};
+		nk_layout_row(ctx, NK_DYNAMIC, widget_h, 3, table);
+		nk_label(ctx, "type", NK_TEXT_LEFT);
+		nk_label(ctx, "events", NK_TEXT_RIGHT);
+		nk_label(ctx, "bytes", NK_TEXT_RIGHT);
+
+		for(uint32_t i = 0; i < sum->ntypes; i++)
+		{
+			const char *uri = sum->types[i]
+				? handle->unmap->unmap(handle->unmap->handle, sum->types[i])
+				: "other";
+
+			nk_layout_row(ctx, NK_DYNAMIC, widget_h, 3, table);
+			nk_label(ctx, uri ? uri : "-", NK_TEXT_LEFT);
+			nk_labelf(ctx, NK_TEXT_RIGHT, "%"PRIi32, sum->counts[i]);
+			nk_labelf(ctx, NK_TEXT_RIGHT, "%"PRIi64, sum->sizes[i]);
+		}
+	}
+
+	nk_group_end(ctx);
+}
+
+static void
+_marker_decode(plughandle_t *handle, const LV2_Atom_Object *obj)
+{
+	const transport_urid_t *urid = &handle->transport_urid;
+	const LV2_Atom_Int *flags = NULL;
+	const LV2_Atom_Long *expected = NULL;
+	const LV2_Atom_Long *frame = NULL;
+	const LV2_Atom_Long *bar = NULL;
+	const LV2_Atom_Float *bar_beat = NULL;
+	const LV2_Atom_Float *bpm = NULL;
+	const LV2_Atom_Float *speed = NULL;
+
+	lv2_atom_object_get(obj,
+		urid->flags, &flags,
+		urid->expected, &expected,
+		urid->frame, &frame,
+		urid->bar, &bar,
+		urid->bar_beat, &bar_beat,
+		urid->bpm, &bpm,
+		urid->speed, &speed,
+		0);
+
+	if(!flags || !expected || !frame || !bar || !bar_beat || !bpm || !speed)
+		return;
+
+	if(handle->state.block || (handle->full && !handle->state.overwrite) )
+		return;
+
+	item_t *itm = _append_item(handle, ITEM_TYPE_MARKER, 0);
+	if(!itm)
+		return;
+
+	itm->marker.flags = flags->body;
+	itm->marker.expected = expected->body;
+	itm->marker.frame = frame->body;
+	itm->marker.bar = bar->body;
+	itm->marker.bar_beat = bar_beat->body;
+	itm->marker.bpm = bpm->body;
+	itm->marker.speed = speed->body;
+}
+
+static void
+_stats_decode(plughandle_t *handle, const LV2_Atom_Object *obj)
+{
+	const stats_urid_t *urid = &handle->stats_urid;
+	summary_t *sum = &handle->summary;
+	const LV2_Atom_Long *offset = NULL;
+	const LV2_Atom_Double *seconds = NULL;
+	const LV2_Atom_Int *cycles = NULL;
+	const LV2_Atom_Long *events = NULL;
+	const LV2_Atom_Int *peak = NULL;
+	const LV2_Atom_Long *bytes = NULL;
+	const LV2_Atom_Long *min_frames = NULL;
+	const LV2_Atom_Long *max_frames = NULL;
+	const LV2_Atom_Int *largest = NULL;
+	const LV2_Atom_URID *largest_type = NULL;
+	const LV2_Atom_Vector *types = NULL;
+	const LV2_Atom_Vector *counts = NULL;
+	const LV2_Atom_Vector *sizes = NULL;
+
+	lv2_atom_object_get(obj,
+		urid->offset, &offset,
+		urid->period, &seconds,
+		urid->cycles, &cycles,
+		urid->events, &events,
+		urid->peak, &peak,
+		urid->bytes, &bytes,
+		urid->min_frames, &min_frames,
+		urid->max_frames, &max_frames,
+		urid->largest, &largest,
+		urid->largest_type, &largest_type,
+		urid->types, &types,
+		urid->counts, &counts,
+		urid->sizes, &sizes,
+		0);
+
+	if(  !offset || !seconds || !cycles || !events || !peak || !bytes
+		|| !min_frames || !max_frames || !largest || !largest_type
+		|| !types || !counts || !sizes)
+	{
+		return;
+	}
+
+	sum->offset = offset->body;
+	sum->seconds = seconds->body;
+	sum->cycles = cycles->body;
+	sum->events = events->body;
+	sum->peak = peak->body;
+	sum->bytes = bytes->body;
+	sum->min_frames = min_frames->body;
+	sum->max_frames = max_frames->body;
+	sum->largest = largest->body;
+	sum->largest_type = largest_type->body;
+
+	uint32_t n = (types->atom.size - sizeof(LV2_Atom_Vector_Body)) / sizeof(LV2_URID);
+	if(n > STATS_SIZE)
+		n = STATS_SIZE;
+	if( (counts->atom.size - sizeof(LV2_Atom_Vector_Body)) / sizeof(int32_t) < n)
+		n = 0;
+	if( (sizes->atom.size - sizeof(LV2_Atom_Vector_Body)) / sizeof(int64_t) < n)
+		n = 0;
+
+	memcpy(sum->types, LV2_ATOM_CONTENTS_CONST(LV2_Atom_Vector, types), n*sizeof(LV2_URID));
+	memcpy(sum->counts, LV2_ATOM_CONTENTS_CONST(LV2_Atom_Vector, counts), n*sizeof(int32_t));
+	memcpy(sum->sizes, LV2_ATOM_CONTENTS_CONST(LV2_Atom_Vector, sizes), n*sizeof(int64_t));
+	sum->ntypes = n;
+}
+
+// returns whether the event is complete
+static bool
+_fragment_append(plughandle_t *handle, const LV2_Atom_Object *obj)
+{
+	const fragment_urid_t *urid = &handle->fragment_urid;
+	const LV2_Atom_Int *id = NULL;
+	const LV2_Atom_Int *index = NULL;
+	const LV2_Atom_Long *offset = NULL;
+	const LV2_Atom_Int *nsamples = NULL;
+	const LV2_Atom_Int *total = NULL;
+	const LV2_Atom *data = NULL;
+
+	lv2_atom_object_get(obj,
+		urid->id, &id,
+		urid->index, &index,
+		urid->offset, &offset,
+		urid->nsamples, &nsamples,
+		urid->total, &total,
+		urid->data, &data,
+		0);
+
+	if(  !id || !index || !offset || !nsamples || !total || !data
+		|| (total->body < (int32_t)sizeof(LV2_Atom_Event)) )
+	{
+		return false;
+	}
+
+	if(index->body == 0) // start of transfer
+	{
+		if(handle->fragment_max < (uint32_t)total->body)
+		{
+			LV2_Atom_Event *fragment = realloc(handle->fragment, total->body);
+			if(!fragment)
+				return false;
+
+			handle->fragment = fragment;
+			handle->fragment_max = total->body;
+		}
+
+		handle->fragment_id = id->body;
+		handle->fragment_index = 0;
+		handle->fragment_size = 0;
+		handle->fragment_total = total->body;
+		handle->fragment_offset = offset->body;
+		handle->fragment_nsamples = nsamples->body;
+	}
+	else if( (id->body != (int32_t)handle->fragment_id)
+		|| (index->body != (int32_t)handle->fragment_index) )
+	{
+		return false; // missed start or a piece of transfer
+	}
+
+	if(handle->fragment_size + data->size > handle->fragment_total)
+		return false;
+
+	memcpy((uint8_t *)handle->fragment + handle->fragment_size, LV2_ATOM_BODY_CONST(data), data->size);
+	handle->fragment_size += data->size;
+	handle->fragment_index += 1;
+
+	return (handle->fragment_size == handle->fragment_total)
+		&& (sizeof(LV2_Atom_Event) + handle->fragment->body.size <= handle->fragment_total);
+}
+
 static LV2UI_Handle
 instantiate(const LV2UI_Descriptor *descriptor, const char *plugin_uri,
 	const char *bundle_path, LV2UI_Write_Function write_function,
@@ -308,6 +808,8 @@ instantiate(const LV2UI_Descriptor *descriptor, const char *plugin_uri,
 	}
 
 	handle->event_transfer = handle->map->map(handle->map->handle, LV2_ATOM__eventTransfer);
+	handle->midi_event = handle->map->map(handle->map->handle, LV2_MIDI__MidiEvent);
+	handle->packed_midi = handle->map->map(handle->map->handle, SHERLOCK_URI"#PackedMidi");
 	lv2_atom_forge_init(&handle->forge, handle->map);
 	lv2_osc_urid_init(&handle->osc_urid, handle->map);
 
@@ -323,6 +825,13 @@ instantiate(const LV2UI_Descriptor *descriptor, const char *plugin_uri,
 		return NULL;
 	}
 
+	if(!arena_init(&handle->arena, ITEM_BUDGET, ITEM_AVERAGE))
+	{
+		fprintf(stderr, "failed to allocate item arena\n");
+		free(handle);
+		return NULL;
+	}
+
 	handle->urid.overwrite = props_map(&handle->props, SHERLOCK_URI"#overwrite");
 	handle->urid.block = props_map(&handle->props, SHERLOCK_URI"#block");
 	handle->urid.follow = props_map(&handle->props, SHERLOCK_URI"#follow");
@@ -330,6 +839,21 @@ instantiate(const LV2UI_Descriptor *descriptor, const char *plugin_uri,
 	handle->urid.trace = props_map(&handle->props, SHERLOCK_URI"#trace");
 	handle->urid.filter = props_map(&handle->props, SHERLOCK_URI"#filter");
 	handle->urid.negate = props_map(&handle->props, SHERLOCK_URI"#negate");
+	handle->urid.lossless = props_map(&handle->props, SHERLOCK_URI"#lossless");
+	handle->urid.filters = props_map(&handle->props, SHERLOCK_URI"#filters");
+	handle->urid.predicate = props_map(&handle->props, SHERLOCK_URI"#predicate");
+	handle->urid.channels = props_map(&handle->props, SHERLOCK_URI"#channels");
+	handle->urid.statuses = props_map(&handle->props, SHERLOCK_URI"#statuses");
+	handle->urid.range_min = props_map(&handle->props, SHERLOCK_URI"#rangeMin");
+	handle->urid.range_max = props_map(&handle->props, SHERLOCK_URI"#rangeMax");
+	handle->urid.pattern = props_map(&handle->props, SHERLOCK_URI"#pattern");
+	handle->urid.record = props_map(&handle->props, SHERLOCK_URI"#record");
+	handle->urid.record_path = props_map(&handle->props, SHERLOCK_URI"#recordPath");
+	handle->urid.stats = props_map(&handle->props, SHERLOCK_URI"#stats");
+	handle->urid.stats_period = props_map(&handle->props, SHERLOCK_URI"#statsPeriod");
+	_stats_urid_init(&handle->stats_urid, handle->map);
+	_fragment_urid_init(&handle->fragment_urid, handle->map);
+	_transport_urid_init(&handle->transport_urid, handle->map);
 
 	nk_pugl_config_t *cfg = &handle->win.cfg;
 	cfg->height = 700;
@@ -387,9 +911,12 @@ cleanup(LV2UI_Handle instance)
 
 	sratom_free(handle->sratom);
 
-	_clear_items(handle);
+	arena_deinit(&handle->arena);
 	nk_textedit_free(&handle->editor);
 
+	if(handle->fragment)
+		free(handle->fragment);
+
 	if(handle->editor.lexer.tokens)
 		free(handle->editor.lexer.tokens);
 
@@ -401,47 +928,175 @@ cleanup(LV2UI_Handle instance)
 	free(handle);
 }
 
-static void
-_osc_bundle(plughandle_t *handle, const LV2_Atom_Object *obj);
+typedef struct _cycle_t cycle_t;
+
+// frame line of a cycle, only appended once there is an uncollapsed event
+struct _cycle_t {
+	int64_t offset;
+	int32_t nsamples;
+	bool appended;
+};
+
+// size of render record, trailing the event body
+static size_t
+_row_size(plughandle_t *handle, uint32_t size, const void *body)
+{
+	switch(handle->type)
+	{
+		case SHERLOCK_MIDI_INSPECTOR:
+			return sizeof(row_t) + (size ? (size + 3) / 4 : 1) * sizeof(((row_t *)0)->hex[0]);
+		case SHERLOCK_ATOM_INSPECTOR:
+			return sizeof(row_t);
+		case SHERLOCK_OSC_INSPECTOR:
+			return sizeof(row_t) + _osc_inspector_size(handle, size, body);
+	}
+
+	return 0;
+}
 
 static void
-_osc_message(plughandle_t *handle, const LV2_Atom_Object *obj)
+_repeat_event(plughandle_t *handle, item_t *itm, uint32_t count, int64_t last)
+{
+	itm->event.repeat += count;
+	itm->event.last = last;
+
+	_midi_inspector_decode(handle, itm); // repeat count is part of the label
+}
+
+// repeats of the last event are only counted, also across cycles
+static item_t *
+_last_event(plughandle_t *handle, uint32_t size, const void *body)
 {
-	const LV2_Atom_String *path = NULL;
-	const LV2_Atom_Tuple *args = NULL;
-	lv2_osc_message_get(&handle->osc_urid, obj, &path, &args);
+	if( (handle->type != SHERLOCK_MIDI_INSPECTOR) || (handle->n_item == 0) || (size > 3) )
+		return NULL;
 
-	LV2_ATOM_TUPLE_FOREACH(args, arg)
+	item_t *itm = _item_get(handle, handle->n_item - 1);
+
+	if(  (itm->type != ITEM_TYPE_EVENT) || (itm->event.ev.body.size != size)
+		|| memcmp(LV2_ATOM_BODY_CONST(&itm->event.ev.body), body, size) )
 	{
-		_append_item(handle, ITEM_TYPE_NONE, 0);
+		return NULL;
 	}
+
+	return itm;
 }
 
-static void
-_osc_packet(plughandle_t *handle, const LV2_Atom_Object *obj)
+static bool
+_append_event(plughandle_t *handle, cycle_t *cycle, int64_t frames, LV2_URID type,
+	uint32_t size, const void *body)
 {
-	if(lv2_osc_is_message_type(&handle->osc_urid, obj->body.otype))
+	item_t *last = _last_event(handle, size, body);
+	if(last)
 	{
-		//_append_item(handle, ITEM_TYPE_NONE, 0);
-		_osc_message(handle, obj);
+		_repeat_event(handle, last, 1, cycle->offset + frames);
+		return true;
 	}
-	else if(lv2_osc_is_bundle_type(&handle->osc_urid, obj->body.otype))
+
+	if(!cycle->appended)
+	{
+		item_t *itm = _append_item(handle, ITEM_TYPE_FRAME, 0);
+		if(!itm)
+			return false;
+
+		itm->frame.offset = cycle->offset;
+		itm->frame.counter = handle->counter;
+		itm->frame.nsamples = cycle->nsamples;
+
+		cycle->appended = true;
+	}
+
+	item_t *itm = _append_item(handle, ITEM_TYPE_EVENT, sizeof(LV2_Atom_Event)
+		+ _row_offset(size) + _row_size(handle, size, body));
+	if(!itm)
+		return false;
+
+	itm->event.repeat = 1;
+	itm->event.last = cycle->offset + frames;
+	LV2_Atom_Event *ev = &itm->event.ev;
+	ev->time.frames = frames;
+	ev->body.size = size;
+	ev->body.type = type;
+	memcpy(LV2_ATOM_BODY(&ev->body), body, size);
+
+	switch(handle->type)
 	{
-		_append_item(handle, ITEM_TYPE_NONE, 0);
-		_osc_bundle(handle, obj);
+		case SHERLOCK_ATOM_INSPECTOR:
+		{
+			_atom_inspector_decode(handle, itm);
+
+			if(handle->state.follow)
+			{
+				handle->selected = &ev->body;
+				handle->selected_item = arena_id(&handle->arena, handle->n_item - 1);
+				handle->ttl_dirty = true;
+			}
+		} break;
+		case SHERLOCK_OSC_INSPECTOR:
+		{
+			_osc_inspector_decode(handle, itm);
+
+			// packets may span over multiple lines
+			const row_t *row = _item_row(itm);
+			for(uint32_t j = 1; j < row->osc.nlines; j++)
+				_append_item(handle, ITEM_TYPE_NONE, 0); // place holder
+		} break;
+		case SHERLOCK_MIDI_INSPECTOR:
+		{
+			_midi_inspector_decode(handle, itm);
+
+			// sysex messages may span over multiple lines
+			const uint8_t *msg = body;
+			if( (msg[0] == 0xf0) && (size > 4) )
+			{
+				for(uint32_t j = 4; j < size; j += 4)
+					_append_item(handle, ITEM_TYPE_NONE, 0); // place holder
+			}
+		} break;
 	}
+
+	return true;
 }
 
+// unpacks records into plain events, long messages are taken from the chunk
 static void
-_osc_bundle(plughandle_t *handle, const LV2_Atom_Object *obj)
+_append_packed(plughandle_t *handle, cycle_t *cycle, const LV2_Atom_Vector *vec,
+	const LV2_Atom *chunk)
 {
-	const LV2_Atom_Object *timetag = NULL;
-	const LV2_Atom_Tuple *items = NULL;
-	lv2_osc_bundle_get(&handle->osc_urid, obj, &timetag, &items);
-
-	LV2_ATOM_TUPLE_FOREACH(items, item)
+	const packed_midi_t *rec = LV2_ATOM_CONTENTS_CONST(LV2_Atom_Vector, vec);
+	const uint32_t n = (vec->atom.size - sizeof(LV2_Atom_Vector_Body)) / sizeof(packed_midi_t);
+	const uint8_t *spill = chunk ? LV2_ATOM_BODY_CONST(chunk) : NULL;
+	const uint32_t spill_size = chunk ? chunk->size : 0;
+	uint32_t pos = 0;
+	bool appended = false; // whether the previous message made it into the list
+
+	for(uint32_t j = 0; j < n; j++, rec++)
 	{
-		_osc_packet(handle, (const LV2_Atom_Object *)item);
+		if(rec->size == PACK_REPEAT) // run of the previous message
+		{
+			const uint32_t count = rec->data[0] | (rec->data[1] << 8) | (rec->data[2] << 16);
+			item_t *last = appended && handle->n_item
+				? _item_get(handle, handle->n_item - 1)
+				: NULL;
+
+			if(last && (last->type == ITEM_TYPE_EVENT) )
+				_repeat_event(handle, last, count, cycle->offset + rec->frames);
+			appended = false; // a run is never followed by another
+			continue;
+		}
+
+		if(rec->size) // inline
+		{
+			appended = _append_event(handle, cycle, rec->frames, handle->midi_event, rec->size, rec->data);
+			continue;
+		}
+
+		const uint32_t size = rec->data[0] | (rec->data[1] << 8) | (rec->data[2] << 16);
+
+		if(!size || (pos + size > spill_size) ) // truncated chunk
+			break;
+
+		appended = _append_event(handle, cycle, rec->frames, handle->midi_event, size, &spill[pos]);
+		pos += size;
 	}
 }
 
@@ -460,6 +1115,57 @@ port_event(LV2UI_Handle instance, uint32_t i, uint32_t size, uint32_t urid,
 		case 2:
 		{
 			const LV2_Atom_Tuple *tup = buf;
+			const LV2_Atom_Object *obj = buf;
+
+			if(  lv2_atom_forge_is_object_type(&handle->forge, obj->atom.type)
+				&& (obj->body.otype == handle->stats_urid.Stats) )
+			{
+				_stats_decode(handle, obj);
+				nk_pugl_post_redisplay(&handle->win);
+
+				break;
+			}
+
+			if(  lv2_atom_forge_is_object_type(&handle->forge, obj->atom.type)
+				&& (obj->body.otype == handle->transport_urid.Discontinuity) )
+			{
+				_marker_decode(handle, obj);
+				nk_pugl_post_redisplay(&handle->win);
+
+				break;
+			}
+
+			if(  lv2_atom_forge_is_object_type(&handle->forge, obj->atom.type)
+				&& (obj->body.otype == handle->fragment_urid.Fragment) )
+			{
+				ser_atom_t ser;
+
+				// complete event is handled like any other notify tuple
+				if(_fragment_append(handle, obj) && (ser_atom_init(&ser) == 0) )
+				{
+					const LV2_Atom_Event *ev = handle->fragment;
+					LV2_Atom_Forge_Frame frame [2];
+
+					ser_atom_reset(&ser, &handle->forge);
+					lv2_atom_forge_tuple(&handle->forge, &frame[0]);
+					lv2_atom_forge_long(&handle->forge, handle->fragment_offset);
+					lv2_atom_forge_int(&handle->forge, handle->fragment_nsamples);
+					lv2_atom_forge_sequence_head(&handle->forge, &frame[1], 0);
+					lv2_atom_forge_frame_time(&handle->forge, ev->time.frames);
+					lv2_atom_forge_write(&handle->forge, &ev->body, sizeof(LV2_Atom) + ev->body.size);
+					lv2_atom_forge_pop(&handle->forge, &frame[1]);
+					lv2_atom_forge_long(&handle->forge, handle->dropped);
+					lv2_atom_forge_long(&handle->forge, handle->skipped);
+					lv2_atom_forge_pop(&handle->forge, &frame[0]);
+
+					const LV2_Atom *atom = ser_atom_get(&ser);
+					port_event(instance, i, lv2_atom_total_size(atom), urid, atom);
+
+					ser_atom_deinit(&ser);
+				}
+
+				break;
+			}
 
 			if(tup->atom.type != handle->forge.Tuple)
 			{
@@ -488,6 +1194,8 @@ port_event(LV2UI_Handle instance, uint32_t i, uint32_t size, uint32_t urid,
 			const LV2_Atom_Long *offset = NULL;
 			const LV2_Atom_Int *nsamples = NULL;
 			const LV2_Atom_Sequence *seq = NULL;
+			const LV2_Atom_Vector *vec = NULL;
+			const LV2_Atom *chunk = NULL;
 
 			unsigned k = 0;
 			LV2_ATOM_TUPLE_FOREACH(tup, item)
@@ -508,22 +1216,58 @@ port_event(LV2UI_Handle instance, uint32_t i, uint32_t size, uint32_t urid,
 					{
 						if(item->type == handle->forge.Sequence)
 							seq = (const LV2_Atom_Sequence *)item;
+						else if( (item->type == handle->forge.Vector)
+								&& (((const LV2_Atom_Vector *)item)->body.child_type == handle->packed_midi)
+								&& (((const LV2_Atom_Vector *)item)->body.child_size == sizeof(packed_midi_t)) )
+							vec = (const LV2_Atom_Vector *)item;
+					} break;
+					case 3:
+					{
+						if(item->type == handle->forge.Long)
+							handle->dropped = ((const LV2_Atom_Long *)item)->body;
+					} break;
+					case 4:
+					{
+						if(item->type == handle->forge.Long)
+							handle->skipped = ((const LV2_Atom_Long *)item)->body;
+					} break;
+					case 5:
+					{
+						const LV2_Atom_Vector *probe = (const LV2_Atom_Vector *)item;
+
+						// windows without a finished cycle are all zero
+						if(  (item->type == handle->forge.Vector)
+							&& (probe->body.child_type == handle->forge.Long)
+							&& (probe->atom.size == sizeof(LV2_Atom_Vector_Body) + sizeof(handle->probe))
+							&& ((const int64_t *)LV2_ATOM_CONTENTS_CONST(LV2_Atom_Vector, probe))[PROBE_RUN_MAX] )
+						{
+							memcpy(handle->probe, LV2_ATOM_CONTENTS_CONST(LV2_Atom_Vector, probe),
+								sizeof(handle->probe));
+						}
+					} break;
+					case 6:
+					{
+						if(item->type == handle->forge.Chunk)
+							chunk = item;
 					} break;
 				}
 
 				k++;
 			}
 
-			const bool overflow = handle->n_item > MAX_LINES;
+			const bool overflow = handle->full && !handle->state.overwrite;
 
-			if(!offset || !nsamples || !seq || (seq->atom.size <= sizeof(LV2_Atom_Sequence_Body)) )
+			if(!offset || !nsamples)
 			{
 				break;
 			}
 
-			if(overflow && handle->state.overwrite)
+			// tuple without events only updates counters
+			if(seq ? (seq->atom.size <= sizeof(LV2_Atom_Sequence_Body))
+				: (!vec || (vec->atom.size <= sizeof(LV2_Atom_Vector_Body))) )
 			{
-				_clear(handle);
+				nk_pugl_post_redisplay(&handle->win);
+				break;
 			}
 
 			if(overflow || handle->state.block)
@@ -531,56 +1275,28 @@ port_event(LV2UI_Handle instance, uint32_t i, uint32_t size, uint32_t urid,
 				break;
 			}
 
-			// append frame
+			// frame is appended with the first event which is not a repeat
+			cycle_t cycle = {
+				.offset = offset->body,
+				.nsamples = nsamples->body,
+				.appended = false
+			};
+
+			if(vec)
 			{
-				item_t *itm = _append_item(handle, ITEM_TYPE_FRAME, 0);
-				itm->frame.offset = offset->body;
-				itm->frame.counter = handle->counter++;
-				itm->frame.nsamples = nsamples->body;
+				_append_packed(handle, &cycle, vec, chunk);
 			}
-
-			LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
+			else
 			{
-				const size_t ev_sz = sizeof(LV2_Atom_Event) + ev->body.size;
-				item_t *itm = _append_item(handle, ITEM_TYPE_EVENT, ev_sz);
-				memcpy(&itm->event.ev, ev, ev_sz);
-
-				switch(handle->type)
+				LV2_ATOM_SEQUENCE_FOREACH(seq, ev)
 				{
-					case SHERLOCK_ATOM_INSPECTOR:
-					{
-						if(handle->state.follow)
-						{
-							handle->selected = &itm->event.ev.body;
-							handle->ttl_dirty = true;
-						}
-					} break;
-					case SHERLOCK_OSC_INSPECTOR:
-					{
-						// bundles may span over multiple lines
-						const LV2_Atom_Object *obj = (const LV2_Atom_Object *)&ev->body;
-						if(lv2_osc_is_bundle_type(&handle->osc_urid, obj->body.otype))
-						{
-							_osc_bundle(handle, obj);
-						}
-						else
-						{
-							_osc_message(handle, obj);
-						}
-					} break;
-					case SHERLOCK_MIDI_INSPECTOR:
-					{
-						// sysex messages may span over multiple lines
-						const uint8_t *msg = LV2_ATOM_BODY_CONST(&ev->body);
-						if( (msg[0] == 0xf0) && (ev->body.size > 4) )
-						{
-							for(uint32_t j = 4; j < ev->body.size; j += 4)
-								_append_item(handle, ITEM_TYPE_NONE, 0); // place holder
-						}
-					} break;
+					_append_event(handle, &cycle, ev->time.frames, ev->body.type, ev->body.size,
+						LV2_ATOM_BODY_CONST(&ev->body));
 				}
 			}
 
+			handle->counter++;
+
 			nk_pugl_post_redisplay(&handle->win);
 
 			break;
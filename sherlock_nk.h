@@ -23,18 +23,24 @@
 
 #include <osc.lv2/osc.h>
 #include <sratom/sratom.h>
+#include <arena.h>
 
-#define MAX_LINES 2048
+#define ITEM_BUDGET 0x10000000 // bytes of item arena, pages only become resident once used
+#define ITEM_AVERAGE 128 // expected bytes per item, index is sized by it
 
 typedef enum _plugin_type_t plugin_type_t;
 typedef enum _item_type_t item_type_t;
 typedef struct _item_t item_t;
+typedef struct _row_t row_t;
+typedef struct _line_t line_t;
+typedef struct _summary_t summary_t;
 typedef struct _plughandle_t plughandle_t;
 
 enum _item_type_t {
 	ITEM_TYPE_NONE,
 	ITEM_TYPE_FRAME,
-	ITEM_TYPE_EVENT
+	ITEM_TYPE_EVENT,
+	ITEM_TYPE_MARKER
 };
 
 struct _item_t {
@@ -48,12 +54,77 @@ struct _item_t {
 		} frame;
 
 		struct {
+			int32_t flags;
+			int64_t expected;
+			int64_t frame;
+			int64_t bar;
+			float bar_beat;
+			float bpm;
+			float speed;
+		} marker;
+
+		struct {
+			uint32_t repeat; // identical consecutive events collapsed into this one
+			int64_t last; // frame position of the last repeat
 			LV2_Atom_Event ev;
-			uint8_t body [0];
+			uint8_t body [0]; // padded, followed by row_t
 		} event;
 	};
 };
 
+// event decoded once at ingest, views only draw it
+struct _row_t {
+	char frames [24]; // fits any int64_t
+	char size [12];
+
+	union {
+		struct {
+			char command [28];
+			char cells [3][24];
+			struct nk_color colors [3];
+		} midi;
+
+		struct {
+			const char *uri;
+			char value [32];
+			struct nk_color color;
+		} atom;
+
+		struct {
+			uint32_t nlines; // line_t following the record
+		} osc;
+	};
+
+	char hex [0][12]; // midi only, one line per 4 bytes
+};
+
+// one line of a flattened OSC packet
+struct _line_t {
+	uint32_t size; // padded, up to next line
+	float offset; // indentation of bundle items
+	uint32_t offsets [3]; // of zero terminated cells
+	struct nk_color colors [3];
+	char cells [0];
+};
+
+// last stats summary received from plugin
+struct _summary_t {
+	int64_t offset;
+	double seconds;
+	int32_t cycles;
+	int64_t events;
+	int32_t peak;
+	int64_t bytes;
+	int64_t min_frames;
+	int64_t max_frames;
+	int32_t largest;
+	LV2_URID largest_type;
+	uint32_t ntypes;
+	LV2_URID types [STATS_SIZE];
+	int32_t counts [STATS_SIZE];
+	int64_t sizes [STATS_SIZE];
+};
+
 enum _plugin_type_t {
 	SHERLOCK_ATOM_INSPECTOR,
 	SHERLOCK_MIDI_INSPECTOR,
@@ -69,6 +140,8 @@ struct _plughandle_t {
 	LV2_Atom_Forge forge;
 	LV2_Atom_Forge_Frame frame;
 	LV2_URID event_transfer;
+	LV2_URID midi_event;
+	LV2_URID packed_midi;
 	LV2_OSC_URID osc_urid;
 
 	PROPS_T(props, MAX_NPROPS);
@@ -80,7 +153,22 @@ struct _plughandle_t {
 		LV2_URID trace;
 		LV2_URID filter;
 		LV2_URID negate;
+		LV2_URID lossless;
+		LV2_URID filters;
+		LV2_URID predicate;
+		LV2_URID channels;
+		LV2_URID statuses;
+		LV2_URID range_min;
+		LV2_URID range_max;
+		LV2_URID pattern;
+		LV2_URID record;
+		LV2_URID record_path;
+		LV2_URID stats;
+		LV2_URID stats_period;
 	} urid;
+	stats_urid_t stats_urid;
+	fragment_urid_t fragment_urid;
+	transport_urid_t transport_urid;
 	state_t state;
 	state_t stash;
 
@@ -88,6 +176,7 @@ struct _plughandle_t {
 
 	bool ttl_dirty;
 	const LV2_Atom *selected;
+	size_t selected_item; // record number in item arena
 	struct nk_text_edit editor;
 
 	Sratom *sratom;
@@ -96,14 +185,40 @@ struct _plughandle_t {
 	float dy;
 
 	uint32_t counter;
+	int64_t dropped;
+	int64_t skipped;
+	int64_t probe [PROBE_MAX];
 	int n_item;
-	item_t **items;
+	arena_t arena; // of item_t
+	bool full; // item budget used up
 
 	bool shadow;
 	plugin_type_t type;
 
-	char filter_uri [1024];
-	LV2_URID filter;
+	char filter_uri [4096];
+	bool filter_dirty;
+	uint32_t nfilters;
+
+	char predicate_expr [4096];
+	bool predicate_dirty;
+	bool predicate_error;
+	uint32_t npredicate;
+	char pattern_expr [PATTERN_SIZE];
+	bool pattern_dirty;
+	bool pattern_error;
+	char record_path [PATH_SIZE];
+	bool record_dirty;
+	summary_t summary;
+
+	// oversized event being reassembled from fragments
+	LV2_Atom_Event *fragment;
+	uint32_t fragment_max;
+	uint32_t fragment_id;
+	uint32_t fragment_index; // expected next
+	uint32_t fragment_size; // received so far
+	uint32_t fragment_total;
+	int64_t fragment_offset;
+	int32_t fragment_nsamples;
 };
 
 extern const char *max_items [5];
@@ -124,9 +239,24 @@ _empty(struct nk_context *ctx);
 void
 _set_bool(plughandle_t *handle, LV2_URID property, int32_t val);
 
+void
+_set_int(plughandle_t *handle, LV2_URID property, int32_t val);
+
 void
 _set_urid(plughandle_t *handle, LV2_URID property, uint32_t val);
 
+void
+_set_urids(plughandle_t *handle, LV2_URID property, uint32_t n, const LV2_URID *vals);
+
+void
+_set_chunk(plughandle_t *handle, LV2_URID property, uint32_t size, const void *body);
+
+void
+_set_text(plughandle_t *handle, LV2_URID property, const char *str);
+
+void
+_set_path(plughandle_t *handle, LV2_URID property, const char *str);
+
 void
 _clear(plughandle_t *handle);
 
@@ -142,4 +272,47 @@ _get_scale(plughandle_t *handle);
 int32_t
 _check(struct nk_context *ctx, int32_t state);
 
+void
+_record_edit(plughandle_t *handle, struct nk_context *ctx);
+
+void
+_stats_view(plughandle_t *handle, struct nk_context *ctx);
+
+void
+_probe_view(plughandle_t *handle, struct nk_context *ctx);
+
+static inline item_t *
+_item_get(plughandle_t *handle, int l)
+{
+	return arena_get(&handle->arena, l);
+}
+
+static inline size_t
+_row_offset(uint32_t size)
+{
+	return (size + 7) & ~7;
+}
+
+// render record trails the event body
+static inline row_t *
+_item_row(item_t *itm)
+{
+	return (row_t *)&itm->event.body[_row_offset(itm->event.ev.body.size)];
+}
+
+void
+_marker_view(plughandle_t *handle, struct nk_context *ctx, const item_t *itm);
+
+void
+_midi_inspector_decode(plughandle_t *handle, item_t *itm);
+
+void
+_atom_inspector_decode(plughandle_t *handle, item_t *itm);
+
+size_t
+_osc_inspector_size(plughandle_t *handle, uint32_t size, const void *body);
+
+void
+_osc_inspector_decode(plughandle_t *handle, item_t *itm);
+
 #endif // _SHERLOCK_NK_H